@@ -1,11 +1,14 @@
 #include <stdexcept>
 #include <cmath>
+#include <vector>
 
 #include "abrines-percival.hpp"
+#include "fused-forces.hpp"
 #include <simulbody/interactions/coulomb.hpp>
 
 
 using namespace simulbody;
+using std::size_t;
 
 AbrinesPercivalAtom::AbrinesPercivalAtom(System* system, Element element, double atomicMass)
 		: AbrinesPercivalAtom(system, element, element, atomicMass) {
@@ -26,32 +29,61 @@ void AbrinesPercivalAtom::install() {
 	vector3D r(0, 1.0 / (reducedMass * nucleusCharge), 0);
 	vector3D v(0, 0, nucleusCharge);
 
-	system->setBodyPosition(getElectron("1s1"), system->getBodyPosition(nucleus) + r);
-	system->setBodyVelocity(getElectron("1s1"), system->getBodyVelocity(nucleus) + v);
+	system->setBodyPosition(getElectron(0), system->getBodyPosition(nucleus) + r);
+	system->setBodyVelocity(getElectron(0), system->getBodyVelocity(nucleus) + v);
 
 	if (electronConfiguration == Element::He) {
-		system->setBodyPosition(getElectron("1s2"), system->getBodyPosition(nucleus) - r);
-		system->setBodyVelocity(getElectron("1s2"), system->getBodyVelocity(nucleus) - v);
+		system->setBodyPosition(getElectron(1), system->getBodyPosition(nucleus) - r);
+		system->setBodyVelocity(getElectron(1), system->getBodyVelocity(nucleus) - v);
 	}
 
 	this->setPosition(vector3D(0, 0, 0));
 	this->setVelocity(vector3D(0, 0, 0));
 }
 
-void AbrinesPercivalAtom::randomize(std::mt19937_64 &randomEngine) {
+void AbrinesPercivalAtom::randomize(RandomEngine &randomEngine) {
+	Orbit orbit = drawOrbit(randomEngine);
+	placeElectrons(orbit, solveKeplerEquation(orbit.thetaN, orbit.epsilon));
+}
+
+void AbrinesPercivalAtom::sampleStates(RandomEngine* randomEngines, size_t count, double* states) {
+	std::vector<Orbit> orbits(count);
+	std::vector<double> thetaN(count), epsilon(count), u(count);
+
+	for (size_t i = 0; i < count; i++) {
+		orbits[i] = drawOrbit(randomEngines[i]);
+		thetaN[i] = orbits[i].thetaN;
+		epsilon[i] = orbits[i].epsilon;
+	}
+
+	solveKeplerEquations(thetaN.data(), epsilon.data(), u.data(), count);
+
+	for (size_t i = 0; i < count; i++) {
+		placeElectrons(orbits[i], u[i]);
+		setPosition(vector3D(0, 0, 0));
+		setVelocity(vector3D(0, 0, 0));
+		getState(states + i * getStateSize());
+	}
+}
+
+AbrinesPercivalAtom::Orbit AbrinesPercivalAtom::drawOrbit(RandomEngine &randomEngine) const {
 
 	std::uniform_real_distribution<double> distMinusPiPi(-M_PI, M_PI);
 	std::uniform_real_distribution<double> distMinusOneOne(-1, 1);
 	std::uniform_real_distribution<double> distNull2Pi(0, 2 * M_PI);
 	std::uniform_real_distribution<double> distNullOne(0, 1);
 
-	double phi = distMinusPiPi(randomEngine);
-	double eta = distMinusPiPi(randomEngine);
-	double theta = acos(distMinusOneOne(randomEngine));
-	double epsilon = sqrt(distNullOne(randomEngine));
-	double thetaN = distNull2Pi(randomEngine);
+	Orbit orbit;
+	orbit.phi = distMinusPiPi(randomEngine);
+	orbit.eta = distMinusPiPi(randomEngine);
+	orbit.theta = acos(distMinusOneOne(randomEngine));
+	orbit.epsilon = sqrt(distNullOne(randomEngine));
+	orbit.thetaN = distNull2Pi(randomEngine);
+	return orbit;
+}
 
-	double u = solveKeplerEquation(thetaN, epsilon, 1e-10, randomEngine);
+void AbrinesPercivalAtom::placeElectrons(const Orbit &orbit, double u) {
+	double epsilon = orbit.epsilon;
 
 	double a = nucleusCharge / (2.0 * 0.5 * reducedMass * pow(nucleusCharge, 2));
 	double b = sqrt(2.0 * 0.5 * reducedMass * reducedMass * pow(nucleusCharge, 2));
@@ -60,15 +92,15 @@ void AbrinesPercivalAtom::randomize(std::mt19937_64 &randomEngine) {
 	vector3D P00(0, b * sqrt(1 - epsilon * epsilon) * cos(u) / (1 - epsilon * cos(u)),
 			-b * sin(u) / (1 - epsilon * cos(u)));
 
-	vector3D C0 = C00.eulerRotation(phi, theta, eta);
-	vector3D P0 = P00.eulerRotation(phi, theta, eta);
+	vector3D C0 = C00.eulerRotation(orbit.phi, orbit.theta, orbit.eta);
+	vector3D P0 = P00.eulerRotation(orbit.phi, orbit.theta, orbit.eta);
 
-	system->setBodyPosition(getElectron("1s1"), system->getBodyPosition(nucleus) + C0);
-	system->setBodyVelocity(getElectron("1s1"), system->getBodyVelocity(nucleus) + P0 / reducedMass);
+	system->setBodyPosition(getElectron(0), system->getBodyPosition(nucleus) + C0);
+	system->setBodyVelocity(getElectron(0), system->getBodyVelocity(nucleus) + P0 / reducedMass);
 
 	if (electronConfiguration == Element::He) {
-		system->setBodyPosition(getElectron("1s2"), system->getBodyPosition(nucleus) - C0);
-		system->setBodyVelocity(getElectron("1s2"), system->getBodyVelocity(nucleus) - P0 / reducedMass);
+		system->setBodyPosition(getElectron(1), system->getBodyPosition(nucleus) - C0);
+		system->setBodyVelocity(getElectron(1), system->getBodyVelocity(nucleus) - P0 / reducedMass);
 	}
 }
 
@@ -88,22 +120,105 @@ void AbrinesPercivalAtom::createInteractions() {
 	}
 }
 
-double AbrinesPercivalAtom::solveKeplerEquation(double thetaN, double epsilon, double tolerance,
-		std::mt19937_64 &randomEngine) {
+void AbrinesPercivalAtom::addForces(ForceTopology &topology) const {
+	for (identifier e1 : getElectrons()) {
+		for (identifier e2 : getElectrons()) {
+			if (e1 < e2)
+				topology.addCoulomb(1.0, e1, e2);
+		}
+		topology.addCoulomb(-1.0 * nucleusCharge, e1, nucleus);
+	}
+}
+
+// Markley (1995): a cubic starting value accurate to about 1e-4 everywhere, which one fifth-order
+// Householder step brings to machine precision. There is no convergence loop, so the cost is fixed.
+static inline double eccentricAnomaly(double thetaN, double epsilon) {
+	const double twoPi = 2.0 * M_PI;
+	const double pi2 = M_PI * M_PI;
+
+	// Solved on [0, pi], the other half of the orbit is symmetric.
+	double m = thetaN - twoPi * floor(thetaN / twoPi);
+	bool upper = m > M_PI;
+	m = upper ? twoPi - m : m;
+
+	double alpha = (3.0 * pi2 + 1.6 * M_PI * (M_PI - m) / (1.0 + epsilon)) / (pi2 - 6.0);
+	double d = 3.0 * (1.0 - epsilon) + alpha * epsilon;
+	double q = 2.0 * alpha * d * (1.0 - epsilon) - m * m;
+	double r = 3.0 * alpha * d * (d - 1.0 + epsilon) * m + m * m * m;
+	double w = fabs(r) + sqrt(q * q * q + r * r);
+	w = cbrt(w * w);
+	double u = (2.0 * r * w / (w * w + w * q + q * q) + m) / d;
+
+	double f2 = epsilon * sin(u);
+	double f3 = epsilon * cos(u);
+	double f0 = u - f2 - m;
+	double f1 = 1.0 - f3;
+	double d3 = -f0 / (f1 - 0.5 * f0 * f2 / f1);
+	double d4 = -f0 / (f1 + 0.5 * d3 * f2 + d3 * d3 * f3 / 6.0);
+	double d5 = -f0 / (f1 + 0.5 * d4 * f2 + d4 * d4 * f3 / 6.0 - d4 * d4 * d4 * f2 / 24.0);
+	u += d5;
+
+	return upper ? twoPi - u : u;
+}
+
+// static
+double AbrinesPercivalAtom::solveKeplerEquation(double thetaN, double epsilon) {
+	return eccentricAnomaly(thetaN, epsilon);
+}
+
+// static
+void AbrinesPercivalAtom::solveKeplerEquations(const double* thetaN, const double* epsilon, double* u,
+		size_t count) {
+#pragma omp simd
+	for (size_t i = 0; i < count; i++) {
+		u[i] = eccentricAnomaly(thetaN[i], epsilon[i]);
+	}
+}
+
+// static
+void AbrinesPercivalAtom::propagateKeplerOrbit(vector3D &r, vector3D &v, double mu, double time) {
+	double r0 = sqrt(r.scalarProduct(r));
+	double sigma = r.scalarProduct(v);
+	double a = 1.0 / (2.0 / r0 - v.scalarProduct(v) / mu);
+
+	if (a <= 0.0)
+		throw std::invalid_argument("Only bound orbits can be propagated.");
+
+	// Eccentric anomaly at the start, then the Lagrange coefficients of the change in it.
+	double n = sqrt(mu / (a * a * a));
+	double eCos = 1.0 - r0 / a;
+	double eSin = sigma / sqrt(mu * a);
+	double u0 = atan2(eSin, eCos);
+	double u = solveKeplerEquation(u0 - eSin + n * time, sqrt(eCos * eCos + eSin * eSin));
+
+	double c = cos(u - u0);
+	double s = sin(u - u0);
+	double f = 1.0 - a / r0 * (1.0 - c);
+	double g = a * sigma / mu * (1.0 - c) + r0 * sqrt(a / mu) * s;
+
+	vector3D position = r * f + v * g;
+	double r1 = sqrt(position.scalarProduct(position));
+	double fDot = -sqrt(mu * a) * s / (r1 * r0);
+	double gDot = 1.0 - a / r1 * (1.0 - c);
+
+	v = r * fDot + v * gDot;
+	r = position;
+}
+
+void AbrinesPercivalAtom::propagate(double time) {
+	if (electronConfiguration != Element::H)
+		throw std::logic_error("Only one-electron atoms can be propagated analytically.");
 
-	std::uniform_real_distribution<double> dist(0.1, 6.0);
-	double u0 = dist(randomEngine);
-	double u = u0;
-	int rounds = 0;
+	identifier electron = getElectron(0);
+	vector3D velocity = getVelocity();
+	vector3D center = getPosition() + velocity * time;
 
-	do {
-		u0 = u;
-		u = u - (thetaN + epsilon * sin(u) - u) / (epsilon * cos(u) - 1);
-		rounds++;
-	} while ((abs(u0 - u) > tolerance) && (rounds < 100));
+	vector3D r = system->getBodyPosition(electron) - system->getBodyPosition(nucleus);
+	vector3D v = system->getBodyVelocity(electron) - system->getBodyVelocity(nucleus);
+	propagateKeplerOrbit(r, v, nucleusCharge / reducedMass, time);
 
-	if (abs(u0 - u) > tolerance)
-		return solveKeplerEquation(thetaN, epsilon, tolerance, randomEngine);
-	else
-		return u;
+	system->setBodyPosition(nucleus, center - r * (electronMass / mass));
+	system->setBodyVelocity(nucleus, velocity - v * (electronMass / mass));
+	system->setBodyPosition(electron, center + r * (nucleusMass / mass));
+	system->setBodyVelocity(electron, velocity + v * (nucleusMass / mass));
 }
@@ -15,12 +15,35 @@ public:
 	AbrinesPercivalAtom(System* system, Element electronConfig, Element nucleusElement, double atomicMass);
 
 	virtual void install() override;
-	virtual void randomize(std::mt19937_64 &randomEngine) override;
+	virtual void randomize(RandomEngine &randomEngine) override;
+	virtual void sampleStates(RandomEngine* randomEngines, std::size_t count, double* states) override;
 	virtual void createInteractions() override;
+	virtual void addForces(ForceTopology &topology) const override;
+
+	// Solves the Kepler equation u - epsilon sin(u) = thetaN for the eccentric anomaly u in a fixed number
+	// of operations: Markley's starting value followed by one fifth-order correction.
+	static double solveKeplerEquation(double thetaN, double epsilon);
+	static void solveKeplerEquations(const double* thetaN, const double* epsilon, double* u, std::size_t count);
+
+	// Advances the relative position and velocity of a bound Kepler orbit (r'' = -mu r / |r|^3) by time.
+	static void propagateKeplerOrbit(vector3D &r, vector3D &v, double mu, double time);
+
+	// Advances the unperturbed one-electron atom analytically, its center of mass moving uniformly.
+	void propagate(double time);
 
 private:
-	double solveKeplerEquation(double thetaN, double epsilon, double tolerance,
-			std::mt19937_64 &randomEngine);
+
+	// Random orientation and shape of the microcanonical Kepler orbit.
+	struct Orbit {
+		double phi;
+		double eta;
+		double theta;
+		double epsilon;
+		double thetaN;
+	};
+
+	Orbit drawOrbit(RandomEngine &randomEngine) const;
+	void placeElectrons(const Orbit &orbit, double u);
 };
 
 #endif /* ABRINES_PERCIVAL_HPP */
@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <stdexcept>
+
 #include "atom.hpp"
 
 using namespace simulbody;
@@ -15,35 +18,41 @@ Atom::Atom(System* system, Element electronConfiguration, Element nucleusElement
 	nucleus = system->createBody(nucleusMass);
 	reducedMass = (electronMass * nucleusMass) / (electronMass + nucleusMass);
 
-	orbitNames = PeriodicTable().atomicOrbitals(electronConfiguration);
-	for (string orbitName : orbitNames) {
-		electrons[orbitName] = system->createBody(electronMass);
+	orbitNames = PeriodicTable::atomicOrbitals(electronConfiguration);
+	bodies.reserve(1 + orbitNames.size());
+	bodies.push_back(nucleus);
+	for (size_t orbit = 0; orbit < orbitNames.size(); orbit++) {
+		bodies.push_back(system->createBody(electronMass));
 	}
+
+	mass = nucleusMass + electronMass * orbitNames.size();
 }
 
 identifier Atom::getNucleus() const {
 	return nucleus;
 }
 
-vector<identifier> Atom::getElectrons() const {
-	vector<identifier> result;
-	for (string orbitName : orbitNames) {
-		result.push_back(getElectron(orbitName));
-	}
-	return result;
+span<const identifier> Atom::getElectrons() const {
+	return span<const identifier>(bodies).subspan(1);
 }
 
-std::vector<identifier> Atom::getBodies() const {
-	vector<identifier> bodies = append( { nucleus }, getElectrons());
+span<const identifier> Atom::getBodies() const {
 	return bodies;
 }
 
+size_t Atom::getOrbit(const string &orbitName) const {
+	auto orbit = find(orbitNames.begin(), orbitNames.end(), orbitName);
+	if (orbit == orbitNames.end())
+		throw out_of_range("The atom has no orbit " + orbitName + ".");
+	return orbit - orbitNames.begin();
+}
+
 identifier Atom::getElectron(size_t orbit) const {
-	return getElectron(orbitNames.at(orbit));
+	return bodies.at(1 + orbit);
 }
 
-identifier Atom::getElectron(string orbitName) const {
-	return electrons.at(orbitName);
+identifier Atom::getElectron(const string &orbitName) const {
+	return bodies[1 + getOrbit(orbitName)];
 }
 
 std::vector<Interaction*> Atom::getInteractions() const {
@@ -51,19 +60,27 @@ std::vector<Interaction*> Atom::getInteractions() const {
 }
 
 vector3D Atom::getPosition() const {
-	return system->getGroupCenterOfMass(getBodies());
+	vector3D moment(0.0, 0.0, 0.0);
+	for (identifier body : bodies) {
+		moment = moment + system->getBodyPosition(body) * system->getBodyMass(body);
+	}
+	return moment / mass;
 }
 
 vector3D Atom::getImpulse() const {
-	return system->getGroupImpulse(getBodies());
+	vector3D impulse(0.0, 0.0, 0.0);
+	for (identifier body : bodies) {
+		impulse = impulse + system->getBodyVelocity(body) * system->getBodyMass(body);
+	}
+	return impulse;
 }
 
 vector3D Atom::getVelocity() const {
-	return getImpulse() / getMass();
+	return getImpulse() / mass;
 }
 
 double Atom::getMass() const {
-	return system->getGroupMass(getBodies());
+	return mass;
 }
 
 double Atom::getReducedMass() const {
@@ -86,24 +103,60 @@ Element Atom::getElectronConfiguration() const {
 	return electronConfiguration;
 }
 
-std::vector<string> Atom::getOrbitNames() const {
+span<const string_view> Atom::getOrbitNames() const {
 	return orbitNames;
 }
 
 void Atom::setPosition(vector3D position) {
 	vector3D delta = position - getPosition();
-	for (identifier body : getBodies()) {
+	for (identifier body : bodies) {
 		system->setBodyPosition(body, system->getBodyPosition(body) + delta);
 	}
 }
 
 void Atom::setVelocity(vector3D velocity) {
 	vector3D delta = velocity - getVelocity();
-	for (identifier body : getBodies()) {
+	for (identifier body : bodies) {
 		system->setBodyVelocity(body, system->getBodyVelocity(body) + delta);
 	}
 }
 
+size_t Atom::getStateSize() const {
+	return 6 * bodies.size();
+}
+
+void Atom::getState(double* state) const {
+	static const vector3D axes[3] = { vector3D(1, 0, 0), vector3D(0, 1, 0), vector3D(0, 0, 1) };
+
+	for (identifier body : bodies) {
+		vector3D position = system->getBodyPosition(body);
+		vector3D velocity = system->getBodyVelocity(body);
+		for (const vector3D &axis : axes) {
+			*state++ = position.scalarProduct(axis);
+		}
+		for (const vector3D &axis : axes) {
+			*state++ = velocity.scalarProduct(axis);
+		}
+	}
+}
+
+void Atom::setState(const double* state) {
+	for (identifier body : bodies) {
+		system->setBodyPosition(body, vector3D(state[0], state[1], state[2]));
+		system->setBodyVelocity(body, vector3D(state[3], state[4], state[5]));
+		state += 6;
+	}
+}
+
+void Atom::sampleStates(RandomEngine* randomEngines, size_t count, double* states) {
+	for (size_t i = 0; i < count; i++) {
+		randomize(randomEngines[i]);
+		setPosition(vector3D(0, 0, 0));
+		setVelocity(vector3D(0, 0, 0));
+		getState(states + i * getStateSize());
+	}
+}
+
 double Atom::getEnergy() const {
 	double energy = 0.0;
 
@@ -115,8 +168,9 @@ double Atom::getEnergy() const {
 		energy += system->getPairPotentialEnergy(e1, nucleus);
 	}
 
-	for (identifier body : getBodies()) {
-		energy += system->getBodyKineticEnergyReferenced(body, getVelocity());
+	vector3D velocity = getVelocity();
+	for (identifier body : bodies) {
+		energy += system->getBodyKineticEnergyReferenced(body, velocity);
 	}
 
 	return energy;
@@ -2,13 +2,17 @@
 #define ATOM_HPP
 
 #include <random>
+#include <span>
 #include <vector>
 #include <simulbody/simulator.hpp>
 
 #include "elements.hpp"
+#include "random.hpp"
 
 using namespace simulbody;
 
+class ForceTopology;
+
 class Atom {
 protected:
 	System* system;
@@ -21,8 +25,9 @@ protected:
 	double nucleusCharge;
 
 	identifier nucleus;
-	std::vector<std::string> orbitNames;
-	std::map<std::string, identifier> electrons;
+	std::span<const std::string_view> orbitNames;
+	std::vector<identifier> bodies;		// the nucleus, then the electrons in the order of orbitNames
+	double mass;
 	std::vector<Interaction*> interactions;
 
 public:
@@ -31,10 +36,13 @@ public:
 	Atom(System* system, Element electronConfiguration, Element nucleusElement, double atomicMass);
 
 	identifier getNucleus() const;
-	std::vector<identifier> getElectrons() const;
-	std::vector<identifier> getBodies() const;
+	std::span<const identifier> getElectrons() const;
+	std::span<const identifier> getBodies() const;
+
+	// Orbits are indexed in the order of getOrbitNames(); resolve a name once, outside of the hot paths.
+	std::size_t getOrbit(const std::string &orbitName) const;
 	identifier getElectron(std::size_t orbit) const;
-	identifier getElectron(std::string orbitName) const;
+	identifier getElectron(const std::string &orbitName) const;
 	std::vector<Interaction*> getInteractions() const;
 
 	vector3D getPosition() const;
@@ -48,15 +56,26 @@ public:
 
 	Element getNucleusElement() const;
 	Element getElectronConfiguration() const;
-	std::vector<string> getOrbitNames() const;
+	std::span<const std::string_view> getOrbitNames() const;
 
 	void setPosition(vector3D position);
 	void setVelocity(vector3D velocity);
 
+	// Phase-space state of the bodies in getBodies() order: position and velocity, 6 values each.
+	std::size_t getStateSize() const;
+	void getState(double* state) const;
+	void setState(const double* state);
+
 	virtual void install() = 0;
-	virtual void randomize(std::mt19937_64 &randomEngine) = 0;
+	virtual void randomize(RandomEngine &randomEngine) = 0;
 	virtual void createInteractions() = 0;
 
+	// Adds the interactions of createInteractions() to the topology of a fused force kernel.
+	virtual void addForces(ForceTopology &topology) const = 0;
+
+	// Samples count states (getState() at rest in the origin), the i-th one from the i-th random engine.
+	virtual void sampleStates(RandomEngine* randomEngines, std::size_t count, double* states);
+
 	virtual double getEnergy() const;
 	virtual double getIonizationEnergy(std::string orbit) const;
 	virtual double getOrbitalEnergy(std::string orbit) const;
@@ -0,0 +1,183 @@
+#include <cmath>
+#include <stdexcept>
+
+#include "binding.hpp"
+
+using namespace simulbody;
+
+static double dot(const double a[3], const double b[3]) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void cross(const double a[3], const double b[3], double c[3]) {
+	c[0] = a[1] * b[2] - a[2] * b[1];
+	c[1] = a[2] * b[0] - a[0] * b[2];
+	c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+BindingClassifier::BindingClassifier(System* system, const ForceTopology &topology,
+		std::span<const identifier> electrons, const std::vector<identifier> &centers)
+		: centers(centers.size()) {
+
+	if (electrons.size() * centers.size() > BindingMatrix::maxPairs)
+		throw std::invalid_argument("Too many electron-center pairs for a binding matrix.");
+
+	for (identifier electron : electrons) {
+		for (identifier center : centers) {
+			double electronMass = system->getBodyMass(electron);
+			double centerMass = system->getBodyMass(center);
+
+			Pair pair { };
+			pair.electron = getPhaseOffset(system, electron, false);
+			pair.center = getPhaseOffset(system, center, false);
+			pair.electronVelocity = getPhaseOffset(system, electron, true);
+			pair.centerVelocity = getPhaseOffset(system, center, true);
+			pair.reducedMass = electronMass * centerMass / (electronMass + centerMass);
+
+			for (const PairForces &forces : topology.pairs) {
+				if (!((forces.earth == electron && forces.moon == center)
+						|| (forces.earth == center && forces.moon == electron)))
+					continue;
+
+				pair.charge = forces.charge;
+				pair.heisenberg = forces.heisenberg;
+				pair.alpha = forces.alpha;
+				pair.xi2 = forces.xi * forces.xi;
+				pair.xi4 = pair.xi2 * pair.xi2;
+			}
+
+			pairs.push_back(pair);
+		}
+	}
+}
+
+BindingMatrix BindingClassifier::classify(const Phase &phase) const {
+	BindingMatrix matrix(centers);
+
+	for (std::size_t i = 0; i < pairs.size(); i++) {
+		matrix.setBound(i / centers, i % centers, getPairEnergy(phase, i) < 0.0);
+	}
+
+	return matrix;
+}
+
+bool BindingClassifier::resolve(const Phase &phase, BindingMatrix &matrix, double margin) const {
+	bool resolved = false;
+
+	for (std::size_t electron = 0; electron < pairs.size() / centers; electron++) {
+		std::size_t bound = 0;
+		for (std::size_t center = 0; center < centers; center++) {
+			bound += matrix.isBound(electron, center) ? 1 : 0;
+		}
+		if (bound < 2)
+			continue;
+
+		for (std::size_t center = 0; center < centers; center++) {
+			if (!matrix.isBound(electron, center))
+				continue;
+
+			bool leavesOthers = true;
+			for (std::size_t other = 0; other < centers && leavesOthers; other++) {
+				if (other != center && matrix.isBound(electron, other))
+					leavesOthers = leaves(phase, electron * centers + center, electron * centers + other, margin);
+			}
+
+			if (leavesOthers) {
+				for (std::size_t other = 0; other < centers; other++) {
+					matrix.setBound(electron, other, other == center);
+				}
+				resolved = true;
+				break;
+			}
+		}
+	}
+
+	return resolved;
+}
+
+bool BindingClassifier::leaves(const Phase &phase, std::size_t i, std::size_t j, double margin) const {
+	const Pair &bound = pairs[i];
+	const Pair &other = pairs[j];
+
+	double r[3], v[3], d[3], u[3];
+	for (std::size_t k = 0; k < 3; k++) {
+		r[k] = phase[bound.electron + k] - phase[bound.center + k];
+		v[k] = phase[bound.electronVelocity + k] - phase[bound.centerVelocity + k];
+		d[k] = phase[other.center + k] - phase[bound.center + k];
+		u[k] = phase[other.centerVelocity + k] - phase[bound.centerVelocity + k];
+	}
+
+	// The centers have to move apart.
+	if (dot(d, u) <= 0.0)
+		return false;
+
+	double energy = getPairEnergy(phase, i);
+	double attraction = -bound.charge;
+	if (energy >= 0.0 || attraction <= 0.0)
+		return false;
+
+	double h[3];
+	cross(r, v, h);
+	double hNorm = sqrt(dot(h, h));
+	if (hNorm == 0.0)
+		return false;
+
+	// Ellipse of the Coulomb attraction from the full two-body energy: its apocenter, and the hodograph,
+	// the circle of radius kappa/h about kappa/h (h x e)/|h| that the relative velocity runs through.
+	double kappa = attraction / bound.reducedMass;
+	double apocenter = attraction / (-2.0 * energy) * (1.0 + sqrt(fmax(0.0,
+			1.0 + 2.0 * energy * bound.reducedMass * dot(h, h) / (attraction * attraction))));
+
+	double distance = sqrt(dot(d, d)) - margin * apocenter;
+	if (distance <= 0.0)
+		return false;
+
+	// Bound for good: the other center cannot supply the binding energy over the orbit.
+	if (-energy <= margin * fabs(other.charge) / distance)
+		return false;
+
+	double vh[3], e[3], c[3];
+	cross(v, h, vh);
+	double rNorm = sqrt(dot(r, r));
+	for (std::size_t k = 0; k < 3; k++) {
+		e[k] = vh[k] / kappa - r[k] / rNorm;
+	}
+	cross(h, e, c);
+
+	double radius = kappa / hNorm;
+	double normal = dot(u, h) / hNorm;
+	double offset2 = 0.0;
+	for (std::size_t k = 0; k < 3; k++) {
+		double w = c[k] * radius / hNorm - (u[k] - normal * h[k] / hNorm);
+		offset2 += w * w;
+	}
+	double farthest = sqrt(offset2) + radius;
+	double speed = sqrt(normal * normal + farthest * farthest) / margin;
+
+	// Unbound from the other center where the orbit runs fastest against it; the Heisenberg core only adds
+	// to that energy.
+	return 0.5 * other.reducedMass * speed * speed + other.charge / distance > 0.0;
+}
+
+double BindingClassifier::getPairEnergy(const Phase &phase, std::size_t i) const {
+	const Pair &pair = pairs[i];
+
+	double r2 = 0.0, v2 = 0.0;
+	for (std::size_t k = 0; k < 3; k++) {
+		double r = phase[pair.electron + k] - phase[pair.center + k];
+		double v = phase[pair.electronVelocity + k] - phase[pair.centerVelocity + k];
+		r2 += r * r;
+		v2 += v * v;
+	}
+
+	double energy = 0.5 * pair.reducedMass * v2 + pair.charge / sqrt(r2);
+
+	// The potential of the Heisenberg core, as HeisenbergInteraction::getEnergy() has it.
+	if (pair.heisenberg) {
+		double p2 = v2 * pair.reducedMass * pair.reducedMass;
+		double r4p4 = r2 * r2 * p2 * p2;
+		energy += pair.xi2 * exp(pair.alpha * (1 - r4p4 / pair.xi4)) / (4 * pair.alpha * r2 * pair.reducedMass);
+	}
+
+	return energy;
+}
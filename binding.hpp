@@ -0,0 +1,90 @@
+#ifndef BINDING_HPP
+#define BINDING_HPP
+
+#include <bitset>
+#include <span>
+#include <vector>
+#include <simulbody/simulator.hpp>
+
+#include "fused-forces.hpp"
+
+using namespace simulbody;
+
+// Bound (1) or unbound (0) state of every electron against every center, electron-major.
+class BindingMatrix {
+
+public:
+	static const std::size_t maxPairs = 256;
+
+	BindingMatrix(std::size_t centers)
+			: centers(centers) {
+	}
+
+	bool isBound(std::size_t electron, std::size_t center) const {
+		return bits[electron * centers + center];
+	}
+
+	void setBound(std::size_t electron, std::size_t center, bool bound) {
+		bits[electron * centers + center] = bound;
+	}
+
+	// Whether the electron is bound to any center.
+	bool isBoundToAny(std::size_t electron) const {
+		for (std::size_t center = 0; center < centers; center++) {
+			if (isBound(electron, center))
+				return true;
+		}
+		return false;
+	}
+
+private:
+	std::size_t centers;
+	std::bitset<maxPairs> bits;
+};
+
+// Classifies the electrons of a system as bound or unbound to the heavy centers (nuclei, projectiles):
+// bound if the two-body energy, the kinetic energy of their relative motion with the reduced mass and the
+// potential of the interactions between them, is negative. The pairs are prepared once from the force
+// topology of the system; a classification reads the phase only, without copies or allocation.
+class BindingClassifier {
+
+	struct Pair {
+		std::size_t electron, center;			// offsets of the positions in the phase
+		std::size_t electronVelocity, centerVelocity;
+		double reducedMass;
+		double charge;
+
+		bool heisenberg;
+		double alpha;
+		double xi2;
+		double xi4;
+	};
+
+	std::vector<Pair> pairs;
+	std::size_t centers;
+
+public:
+
+	BindingClassifier(System* system, const ForceTopology &topology, std::span<const identifier> electrons,
+			const std::vector<identifier> &centers);
+
+	BindingMatrix classify(const Phase &phase) const;
+
+	// Decides the electrons bound to several centers from their two-body orbits, once the centers recede
+	// from each other: an electron bound to one center by more than the potential of the others over its
+	// Kepler ellipse stays bound to it, and leaves the others when its velocity, running through the
+	// hodograph of the ellipse, gets fast enough against them. The apocenter and the potential are
+	// multiplied by the margin, the speed is divided by it. Returns whether any electron was decided.
+	bool resolve(const Phase &phase, BindingMatrix &matrix, double margin) const;
+
+	// Two-body energy of the i-th pair (electron-major) in the phase.
+	double getPairEnergy(const Phase &phase, std::size_t pair) const;
+
+private:
+
+	// Whether the electron of the i-th pair, bound to its center, will stay unbound from the center of the
+	// j-th pair.
+	bool leaves(const Phase &phase, std::size_t i, std::size_t j, double margin) const;
+};
+
+#endif /* BINDING_HPP */
@@ -0,0 +1,159 @@
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "campaign.hpp"
+
+using namespace std;
+
+double CollisionScenario::getB2max(size_t energy) const {
+	return b2maxes.size() == 1 ? b2maxes[0] : b2maxes[energy];
+}
+
+// Completes a scenario that has been read and checks it.
+static void finish(CollisionScenario &scenario, const string &fileName) {
+	string where = "scenario " + scenario.name + " of " + fileName;
+
+	if (scenario.energies.empty() || scenario.b2maxes.empty())
+		throw runtime_error("The " + where + " needs an energy and a b2max.");
+	if (scenario.b2maxes.size() != 1 && scenario.b2maxes.size() != scenario.energies.size())
+		throw runtime_error("The " + where + " needs one b2max or one for every energy.");
+
+	bool tolerances = scenario.absoluteStepperError > 0.0 || scenario.relativeStepperError > 0.0
+			|| scenario.relativeEnergyError > 0.0;
+
+	if (!scenario.experiment.empty()) {
+		if (tolerances)
+			throw runtime_error("The built-in experiment of the " + where + " keeps its own tolerances.");
+		return;
+	}
+
+	if (!tolerances) {
+		scenario.absoluteStepperError = 1e-9;
+		scenario.relativeStepperError = 1e-9;
+		scenario.relativeEnergyError = 1e-6;
+	} else if (scenario.absoluteStepperError <= 0.0 || scenario.relativeStepperError <= 0.0
+			|| scenario.relativeEnergyError <= 0.0) {
+		throw runtime_error("The " + where + " needs positive tolerances.");
+	}
+
+	if (scenario.model != "AP" && scenario.model != "KW")
+		throw runtime_error("The " + where + " has no target model AP or KW.");
+	if (scenario.targetMass <= 0.0)
+		scenario.targetMass = PeriodicTable::isotopeMass(scenario.element);
+	if (scenario.targetMass <= 0.0)
+		throw runtime_error("The " + where + " needs the mass of its target.");
+	if (scenario.projectileMass <= 0.0)
+		throw runtime_error("The " + where + " needs a positive projectile mass.");
+}
+
+vector<CollisionScenario> readCampaign(const string &fileName) {
+	ifstream stream(fileName);
+	if (!stream)
+		throw runtime_error("Failed to open campaign file " + fileName + ".");
+
+	vector<CollisionScenario> scenarios;
+	string line;
+	for (int number = 1; getline(stream, line); number++) {
+		line = line.substr(0, line.find('#'));
+		istringstream fields(line);
+		string key;
+		if (!(fields >> key))
+			continue;
+
+		string where = " in line " + to_string(number) + " of " + fileName + ".";
+
+		if (key == "scenario") {
+			if (!scenarios.empty())
+				finish(scenarios.back(), fileName);
+
+			// Names label the output files of the scenario.
+			string name;
+			fields >> name;
+			if (name.find('/') != string::npos)
+				throw runtime_error("Scenario name '" + name + "' with a '/'" + where);
+			for (const CollisionScenario &scenario : scenarios) {
+				if (scenario.name == name)
+					throw runtime_error("Duplicate scenario '" + name + "'" + where);
+			}
+
+			scenarios.emplace_back();
+			scenarios.back().name = name;
+		} else if (scenarios.empty()) {
+			throw runtime_error("Key '" + key + "' before the first scenario" + where);
+		} else {
+			CollisionScenario &scenario = scenarios.back();
+
+			if (key == "experiment") {
+				fields >> scenario.experiment;
+			} else if (key == "target") {
+				string symbol;
+				fields >> symbol >> scenario.model;
+				if (!PeriodicTable::findElement(symbol, scenario.element))
+					throw runtime_error("Unknown element '" + symbol + "'" + where);
+
+				// The mass is optional.
+				double mass;
+				if (fields >> mass)
+					scenario.targetMass = mass;
+				else if (fields.eof())
+					fields.clear();
+			} else if (key == "projectile") {
+				fields >> scenario.projectileCharge >> scenario.projectileMass;
+			} else if (key == "energy" || key == "b2max") {
+				string text;
+				fields >> text;
+				if (!parseValues(text, key == "energy" ? scenario.energies : scenario.b2maxes))
+					throw runtime_error("Invalid " + key + " '" + text + "'" + where);
+			} else if (key == "tolerances") {
+				fields >> scenario.absoluteStepperError >> scenario.relativeStepperError
+						>> scenario.relativeEnergyError;
+			} else {
+				throw runtime_error("Unknown key '" + key + "'" + where);
+			}
+		}
+
+		string rest;
+		if (fields.fail() || fields >> rest)
+			throw runtime_error("Malformed '" + key + "'" + where);
+	}
+
+	if (scenarios.empty())
+		throw runtime_error("No scenarios in campaign file " + fileName + ".");
+
+	finish(scenarios.back(), fileName);
+	return scenarios;
+}
+
+bool parseValues(const string &text, vector<double> &values) {
+	values.clear();
+	istringstream stream(text);
+	double value = 0;
+	char separator = 0;
+
+	if (text.find(':') != string::npos) {
+		double start = 0, stop = 0, step = 0;
+		char second = 0;
+		stream >> start >> separator >> stop >> second >> step;
+		if (!stream || separator != ':' || second != ':' || step <= 0 || stop < start)
+			return false;
+
+		// Steps are counted rather than accumulated, so the last point is not lost to rounding.
+		long steps = lround(floor((stop - start) / step + 1e-9));
+		for (long i = 0; i <= steps; i++) {
+			values.push_back(start + i * step);
+		}
+		return true;
+	}
+
+	while (stream >> value) {
+		values.push_back(value);
+		if (!(stream >> separator))
+			break;
+		if (separator != ',')
+			return false;
+	}
+
+	return !values.empty() && stream.eof();
+}
@@ -0,0 +1,51 @@
+#ifndef CAMPAIGN_HPP
+#define CAMPAIGN_HPP
+
+#include <string>
+#include <vector>
+
+#include "elements.hpp"
+
+// One collision set-up of a campaign: a built-in experiment, or a target and a projectile for the
+// generic collision experiment, with the energies to carry it out at.
+struct CollisionScenario {
+	std::string name;
+	std::string experiment;				// built-in experiment, empty for the generic one
+
+	Element element = Element::H;
+	std::string model = "KW";			// AP (Abrines-Percival) or KW (Kirschbaum-Wilets)
+	double targetMass = 0.0;			// atomic mass [u]
+	double projectileCharge = 1.0;
+	double projectileMass = 1.00727646688;	// [u], a proton
+
+	std::vector<double> energies;		// [keV]
+	std::vector<double> b2maxes;		// one, or one per energy [au]
+
+	// Built-in experiments keep their own tolerances, the generic one defaults to 1e-9, 1e-9 and 1e-6.
+	double absoluteStepperError = 0.0;
+	double relativeStepperError = 0.0;
+	double relativeEnergyError = 0.0;
+
+	double getB2max(std::size_t energy) const;
+};
+
+// Reads the scenarios of a campaign file. Every scenario starts with its name, unique and without '/', and
+// lists its keys, one per line; '#' starts a comment:
+//
+//   scenario p+Li
+//   target Li KW 7.01600344       element, model and atomic mass [u] (default: the main isotope to Ar)
+//   projectile 1 1.00727646688    charge and mass [u] (default: a proton)
+//   energy 50:200:50              [keV], as --energy
+//   b2max 25                      [au], as --b2max
+//   tolerances 1e-9 1e-9 1e-6     absolute and relative stepper error, relative energy error (defaults)
+//
+//   scenario p+H
+//   experiment p+H                a built-in experiment instead of the target and the projectile
+//   energy 25,50,100
+//   b2max 16
+std::vector<CollisionScenario> readCampaign(const std::string &fileName);
+
+// Parses a single value, a comma separated list or an inclusive range 'start:stop:step'.
+bool parseValues(const std::string &text, std::vector<double> &values);
+
+#endif /* CAMPAIGN_HPP */
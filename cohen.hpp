@@ -1,46 +1,63 @@
 #ifndef COHEN_HPP
 #define COHEN_HPP
 
-#include <map>
-#include <tuple>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <simulbody/simulator.hpp>
 
 #include "elements.hpp"
 
-using namespace std;
+using namespace simulbody;
 
+// Ground-state configurations of Kirschbaum-Wilets atoms after Cohen: position and momentum of every
+// electron relative to the nucleus in spherical coordinates, and its spin. Orbits are indexed by the
+// atomic number and the orbit of the atom.
 struct CohenConfiguration {
 
-	typedef tuple<double, double, double, double, double, double, bool> CohenOrbit;
+	struct CohenOrbit {
+		double r, theta, phi;
+		double p, pTheta, pPhi;
+		bool spin;
+	};
 
-	map<string, CohenOrbit> orbits;
+	static constexpr int maxAtomicNumber = 2;
 
-	CohenConfiguration() {
-		orbits["1:1s1"] = CohenOrbit(1.0000, 0.00, 0.0000, 0.9535, 0.00, 0.0000, true);
+	static constexpr CohenOrbit orbits[] = {
+		{ 1.0000, 0.00, 0.0000, 0.9535, 0.00, 0.0000, true },
 
-		orbits["2:1s1"] = CohenOrbit(0.903, 0.00, 0.0000, 1.392, M_PI/2, 0.0000, true);
-		orbits["2:1s2"] = CohenOrbit(0.903, M_PI, 0.0000, 1.392, -M_PI/2, 0.0000, false);
-	}
+		{ 0.903, 0.00, 0.0000, 1.392, M_PI/2, 0.0000, true },
+		{ 0.903, M_PI, 0.0000, 1.392, -M_PI/2, 0.0000, false }
+	};
+
+	// First orbit of the element of atomic number z is orbits[offsets[z]].
+	static constexpr std::size_t offsets[] = { 0, 0, 1, 3 };
 
-	vector3D position(const Element &element, const string &orbit) {
-		CohenOrbit cohenOrbit = orbits.at(key(element, orbit));
-		vector3D position(get<0>(cohenOrbit), get<1>(cohenOrbit), get<2>(cohenOrbit));
-		return position.convertFromSphericalToCartesian();
+	static bool contains(const Element &element) {
+		return PeriodicTable::atomicNumber(element) <= maxAtomicNumber;
 	}
 
-	vector3D momentum(const Element &element, const string &orbit) {
-		CohenOrbit cohenOrbit = orbits.at(key(element, orbit));
-		vector3D momentum(get<3>(cohenOrbit), get<4>(cohenOrbit), get<5>(cohenOrbit));
-		return momentum.convertFromSphericalToCartesian();
+	static vector3D position(const Element &element, std::size_t orbit) {
+		const CohenOrbit &cohenOrbit = get(element, orbit);
+		return vector3D(cohenOrbit.r, cohenOrbit.theta, cohenOrbit.phi).convertFromSphericalToCartesian();
 	}
 
-	bool spin(const Element &element, const string &orbit) {
-		return get<6>(orbits.at(key(element, orbit)));
+	static vector3D momentum(const Element &element, std::size_t orbit) {
+		const CohenOrbit &cohenOrbit = get(element, orbit);
+		return vector3D(cohenOrbit.p, cohenOrbit.pTheta, cohenOrbit.pPhi).convertFromSphericalToCartesian();
 	}
 
-	string key(const Element &element, const string &orbit) {
-		return to_string(PeriodicTable::atomicNumber(element)) + ":" + orbit;
+	static bool spin(const Element &element, std::size_t orbit) {
+		return get(element, orbit).spin;
 	}
 
+private:
+	static const CohenOrbit& get(const Element &element, std::size_t orbit) {
+		int z = PeriodicTable::atomicNumber(element);
+		if (z > maxAtomicNumber || offsets[z] + orbit >= offsets[z + 1])
+			throw std::out_of_range("No Cohen configuration of the orbit.");
+		return orbits[offsets[z] + orbit];
+	}
 };
 
 #endif /* COHEN_HPP */
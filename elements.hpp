@@ -1,67 +1,169 @@
 #ifndef ORBITALS_HPP
 #define ORBITALS_HPP
 
-#include <map>
+#include <array>
+#include <cstdint>
+#include <span>
 #include <string>
-#include <vector>
+#include <string_view>
 
 using namespace std;
 
-// TODO finish declaring elements over z=18
 enum class Element
 	: int {
-		H = 1, He, Li, Be, B, C, N, O, F, Ne, Na, Mg, Al, Si, P, S, Cl, Ar
+		H = 1, He, Li, Be, B, C, N, O, F, Ne, Na, Mg, Al, Si, P, S, Cl, Ar,
+		K, Ca, Sc, Ti, V, Cr, Mn, Fe, Co, Ni, Cu, Zn, Ga, Ge, As, Se, Br, Kr,
+		Rb, Sr, Y, Zr, Nb, Mo, Tc, Ru, Rh, Pd, Ag, Cd, In, Sn, Sb, Te, I, Xe
 };
 
-template<class T>
-vector<T> append(const vector<T> &a, const vector<T> &b) {
-	vector<T> sum(a);
-	sum.insert(sum.end(), b.begin(), b.end());
-	return sum;
-}
-
+// Element data as compile-time tables: nothing is built or allocated when an atom reads its layout.
 struct PeriodicTable {
-	map<Element, vector<string>> orbitals;
+	static constexpr int maxAtomicNumber = static_cast<int>(Element::Xe);
+	static constexpr size_t subshellCount = 11;
+
+	// Orbitals of the subshells in the order of filling, 1s to 5p, one per electron.
+	static constexpr std::string_view orbitalNames[] = {
+		"1s1", "1s2",
+		"2s1", "2s2",
+		"2p1", "2p2", "2p3", "2p4", "2p5", "2p6",
+		"3s1", "3s2",
+		"3p1", "3p2", "3p3", "3p4", "3p5", "3p6",
+		"4s1", "4s2",
+		"3d1", "3d2", "3d3", "3d4", "3d5", "3d6", "3d7", "3d8", "3d9", "3d10",
+		"4p1", "4p2", "4p3", "4p4", "4p5", "4p6",
+		"5s1", "5s2",
+		"4d1", "4d2", "4d3", "4d4", "4d5", "4d6", "4d7", "4d8", "4d9", "4d10",
+		"5p1", "5p2", "5p3", "5p4", "5p5", "5p6"
+	};
+
+	// Offsets of the subshells in orbitalNames; the last one is the end of the table.
+	static constexpr std::array<size_t, subshellCount + 1> subshellOffsets = {
+		0, 2, 4, 10, 12, 18, 20, 30, 36, 38, 48, 54
+	};
 
-	static int atomicNumber(Element const element) {
+	static constexpr std::string_view symbols[] = {
+		"", "H", "He", "Li", "Be", "B", "C", "N", "O", "F", "Ne", "Na", "Mg", "Al", "Si", "P", "S", "Cl", "Ar",
+		"K", "Ca", "Sc", "Ti", "V", "Cr", "Mn", "Fe", "Co", "Ni", "Cu", "Zn", "Ga", "Ge", "As", "Se", "Br", "Kr",
+		"Rb", "Sr", "Y", "Zr", "Nb", "Mo", "Tc", "Ru", "Rh", "Pd", "Ag", "Cd", "In", "Sn", "Sb", "Te", "I", "Xe"
+	};
+
+	// Atomic masses [u] of the most abundant isotopes, H to Ar.
+	static constexpr double isotopeMasses[] = {
+		0.0, 1.00782503207, 4.00260325, 7.01600344, 9.01218307, 11.00930536, 12.0, 14.00307401, 15.99491462,
+		18.99840316, 19.99244018, 22.98976928, 23.98504170, 26.98153853, 27.97692653, 30.97376200, 31.97207117,
+		34.96885268, 39.96238312
+	};
+
+	static constexpr int atomicNumber(Element const element) {
 		return static_cast<int>(element);
 	}
 
-	vector<string> atomicOrbitals(Element const element) {
-		return orbitals.at(element);
+	static constexpr std::string_view symbol(Element const element) {
+		return symbols[atomicNumber(element)];
+	}
+
+	// The element of a chemical symbol; false if there is none.
+	static constexpr bool findElement(std::string_view symbol, Element &element) {
+		for (int z = 1; z <= maxAtomicNumber; z++) {
+			if (symbols[z] == symbol) {
+				element = static_cast<Element>(z);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Atomic mass of the most abundant isotope [u], 0 beyond Ar.
+	static constexpr double isotopeMass(Element const element) {
+		int z = atomicNumber(element);
+		return z < (int) std::size(isotopeMasses) ? isotopeMasses[z] : 0.0;
 	}
 
-	PeriodicTable() {
-		orbitals[Element::H] = {"1s1"};
-		orbitals[Element::He] = {"1s1", "1s2"};
-
-		orbitals[Element::Li] = {"1s1", "1s2", "2s1"};
-		orbitals[Element::Be] = {"1s1", "1s2", "2s1", "2s2"};
-
-		auto Be = orbitals.at(Element::Be);
-		orbitals[Element::B] = append(Be, {"2p1"});
-		orbitals[Element::C] = append(Be, {"2p1", "2p2"});
-		orbitals[Element::N] = append(Be, {"2p1", "2p2", "2p3"});
-		orbitals[Element::O] = append(Be, {"2p1", "2p2", "2p3", "2p4"});
-		orbitals[Element::F] = append(Be, {"2p1", "2p2", "2p3", "2p4", "2p5"});
-		orbitals[Element::Ne] = append(Be, {"2p1", "2p2", "2p3", "2p4", "2p5", "2p6"});
-
-		auto Ne = orbitals.at(Element::Ne);
-		orbitals[Element::Na] = append(Ne, {"3s1"});
-		orbitals[Element::Mg] = append(Ne, {"3s1", "3s2"});
-
-		auto Mg = orbitals.at(Element::Mg);
-		orbitals[Element::Al] = append(Mg, {"3p1"});
-		orbitals[Element::Si] = append(Mg, {"3p1", "3p2"});
-		orbitals[Element::P] = append(Mg, {"3p1", "3p2", "3p3"});
-		orbitals[Element::S] = append(Mg, {"3p1", "3p2", "3p3", "3p4"});
-		orbitals[Element::Cl] = append(Mg, {"3p1", "3p2", "3p3", "3p4", "3p5"});
-		orbitals[Element::Ar] = append(Mg, {"3p1", "3p2", "3p3", "3p4", "3p5", "3p6"});
+	// Number of orbitals (electrons) of the neutral atom.
+	static constexpr size_t orbitalCount(Element const element) {
+		return static_cast<size_t>(atomicNumber(element));
 	}
 
-	static double nucleusMassInAU(Element const element, double atomicMass) {
-		return atomicMass / 5.485799095 * 10000 - 1.0 * ((double)atomicNumber(element));
+	static constexpr std::span<const std::string_view> atomicOrbitals(Element const element) {
+		const Layout &layout = layouts[atomicNumber(element)];
+		return std::span<const std::string_view>(layout.orbitals.data(), layout.count);
 	}
+
+	// Mass given in u in atomic units (electron masses).
+	static constexpr double massInAU(double mass) {
+		return mass / 5.485799095 * 10000;
+	}
+
+	static constexpr double nucleusMassInAU(Element const element, double atomicMass) {
+		return massInAU(atomicMass) - 1.0 * ((double)atomicNumber(element));
+	}
+
+private:
+	struct Layout {
+		size_t count = 0;
+		std::array<std::string_view, std::size(orbitalNames)> orbitals { };
+	};
+
+	// Ground-state occupancies of the subshells: filled in order, except the transition metals that
+	// move one electron (two for Pd) of the outer s subshell to the d subshell below it.
+	static constexpr std::array<uint8_t, subshellCount> occupancies(Element const element) {
+		std::array<uint8_t, subshellCount> occupancy { };
+		size_t electrons = orbitalCount(element);
+		for (size_t subshell = 0; subshell < subshellCount; subshell++) {
+			size_t capacity = subshellOffsets[subshell + 1] - subshellOffsets[subshell];
+			occupancy[subshell] = static_cast<uint8_t>(electrons < capacity ? electrons : capacity);
+			electrons -= occupancy[subshell];
+		}
+
+		constexpr size_t s4 = 5, d3 = 6, s5 = 8, d4 = 9;
+		switch (element) {
+		case Element::Cr:
+		case Element::Cu:
+			occupancy[s4] -= 1;
+			occupancy[d3] += 1;
+			break;
+		case Element::Nb:
+		case Element::Mo:
+		case Element::Ru:
+		case Element::Rh:
+		case Element::Ag:
+			occupancy[s5] -= 1;
+			occupancy[d4] += 1;
+			break;
+		case Element::Pd:
+			occupancy[s5] -= 2;
+			occupancy[d4] += 2;
+			break;
+		default:
+			break;
+		}
+
+		return occupancy;
+	}
+
+	static constexpr std::array<Layout, maxAtomicNumber + 1> buildLayouts() {
+		std::array<Layout, maxAtomicNumber + 1> layouts { };
+		for (int z = 1; z <= maxAtomicNumber; z++) {
+			std::array<uint8_t, subshellCount> occupancy = occupancies(static_cast<Element>(z));
+			Layout &layout = layouts[z];
+			for (size_t subshell = 0; subshell < subshellCount; subshell++) {
+				for (size_t i = 0; i < occupancy[subshell]; i++) {
+					layout.orbitals[layout.count++] = orbitalNames[subshellOffsets[subshell] + i];
+				}
+			}
+		}
+		return layouts;
+	}
+
+	static const std::array<Layout, maxAtomicNumber + 1> layouts;
 };
 
+inline constexpr std::array<PeriodicTable::Layout, PeriodicTable::maxAtomicNumber + 1> PeriodicTable::layouts =
+		PeriodicTable::buildLayouts();
+
+static_assert(PeriodicTable::subshellOffsets.back() == std::size(PeriodicTable::orbitalNames));
+static_assert(PeriodicTable::atomicOrbitals(Element::He).size() == 2);
+static_assert(PeriodicTable::atomicOrbitals(Element::Xe).back() == "5p6");
+static_assert(std::size(PeriodicTable::symbols) == PeriodicTable::maxAtomicNumber + 1);
+
 #endif /* ORBITALS_HPP */
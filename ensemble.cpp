@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ensemble.hpp"
+#include "abrines-percival.hpp"
+#include "kirschbaum-wilets.hpp"
+
+using namespace std;
+
+static const char ensembleFileMagic[8] = { 'B', 'B', 'E', 'N', 'S', 'M', 'B', '1' };
+static const size_t headerFieldsSize = 32;
+
+TargetEnsemble::TargetEnsemble(const string &fileName) {
+	descriptor = ::open(fileName.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		throw runtime_error("Failed to open target ensemble " + fileName + ".");
+
+	struct stat status;
+	fstat(descriptor, &status);
+	fileSize = status.st_size;
+
+	if (fileSize < headerFieldsSize) {
+		::close(descriptor);
+		throw runtime_error(fileName + " is not a target ensemble.");
+	}
+
+	void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, descriptor, 0);
+	if (mapping == MAP_FAILED) {
+		::close(descriptor);
+		throw runtime_error("Failed to map target ensemble " + fileName + ".");
+	}
+
+	data = static_cast<const char*>(mapping);
+
+	uint32_t sizes[2];
+	memcpy(sizes, data + 8, sizeof(sizes));
+	memcpy(&count, data + 16, 8);
+	memcpy(&seed, data + 24, 8);
+	headerSize = sizes[0];
+	stateSize = sizes[1];
+
+	if (memcmp(data, ensembleFileMagic, 8) != 0 || headerSize > fileSize || stateSize == 0
+			|| headerSize + count * stateSize * sizeof(double) > fileSize) {
+		munmap(mapping, fileSize);
+		::close(descriptor);
+		throw runtime_error(fileName + " is not a target ensemble.");
+	}
+
+	if (count == 0) {
+		munmap(mapping, fileSize);
+		::close(descriptor);
+		throw runtime_error("Target ensemble " + fileName + " holds no states.");
+	}
+
+	target = string(data + headerFieldsSize);
+
+	// Rounds draw the states in order, let the kernel read ahead.
+	madvise(mapping, fileSize, MADV_SEQUENTIAL);
+}
+
+const string& TargetEnsemble::getTarget() const {
+	return target;
+}
+
+size_t TargetEnsemble::getStateSize() const {
+	return stateSize;
+}
+
+uint64_t TargetEnsemble::getSeed() const {
+	return seed;
+}
+
+size_t TargetEnsemble::size() const {
+	return count;
+}
+
+const double* TargetEnsemble::state(size_t index) const {
+	// States are 8-byte aligned: the header is padded to a multiple of 8 bytes.
+	return reinterpret_cast<const double*>(data + headerSize) + index * stateSize;
+}
+
+const double* TargetEnsemble::draw(uint64_t campaignSeed, int round) const {
+	RandomEngine offsetEngine(campaignSeed);
+	uint64_t offset = offsetEngine() % count;
+	return state((offset + (uint64_t) (round - 1)) % count);
+}
+
+TargetEnsemble::~TargetEnsemble() {
+	munmap(const_cast<char*>(data), fileSize);
+	::close(descriptor);
+}
+
+// static
+Atom* TargetEnsemble::createTarget(const string &target, System* system) {
+	if (target == "AP-H")
+		return new AbrinesPercivalAtom(system, Element::H, 1.00782503207);
+	if (target == "AP-He")
+		return new AbrinesPercivalAtom(system, Element::He, 4.00260325);
+	if (target == "KW-He")
+		return new KirschbaumWiletsAtom(system, Element::He, 4.00260325);
+
+	return nullptr;
+}
+
+// static
+void TargetEnsemble::generate(const string &fileName, const string &target, uint64_t count, uint64_t seed,
+		int threads) {
+	if (count == 0)
+		throw runtime_error("An ensemble needs at least one state.");
+
+	System probeSystem;
+	Atom* probe = createTarget(target, &probeSystem);
+	if (probe == nullptr)
+		throw runtime_error("Unknown target " + target + ".");
+
+	size_t stateSize = probe->getStateSize();
+	delete probe;
+
+	vector<char> header(headerFieldsSize, 0);
+	header.insert(header.end(), target.begin(), target.end());
+	header.push_back(0);
+	header.resize((header.size() + 7) / 8 * 8, 0);
+
+	uint32_t sizes[2] = { (uint32_t) header.size(), (uint32_t) stateSize };
+	memcpy(header.data(), ensembleFileMagic, 8);
+	memcpy(header.data() + 8, sizes, sizeof(sizes));
+	memcpy(header.data() + 16, &count, 8);
+	memcpy(header.data() + 24, &seed, 8);
+
+	// The file is mapped and the threads fill in the states in place.
+	size_t fileSize = header.size() + count * stateSize * sizeof(double);
+	int descriptor = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (descriptor < 0)
+		throw runtime_error("Failed to create target ensemble " + fileName + ".");
+	if (ftruncate(descriptor, fileSize) != 0) {
+		::close(descriptor);
+		throw runtime_error("Failed to create target ensemble " + fileName + ".");
+	}
+
+	void* mapping = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, descriptor, 0);
+	if (mapping == MAP_FAILED) {
+		::close(descriptor);
+		throw runtime_error("Failed to map target ensemble " + fileName + ".");
+	}
+
+	char* data = static_cast<char*>(mapping);
+	memcpy(data, header.data(), header.size());
+	double* states = reinterpret_cast<double*>(data + header.size());
+
+	// Threads take the states in batches, which the atoms may sample vectorized.
+	const uint64_t batchSize = 256;
+	atomic<uint64_t> nextState(0);
+	auto work = [&]() {
+		System system;
+		Atom* atom = createTarget(target, &system);
+		vector<RandomEngine> randomEngines(batchSize);
+
+		uint64_t first;
+		while ((first = nextState.fetch_add(batchSize)) < count) {
+			uint64_t batch = min(batchSize, count - first);
+			for (uint64_t i = 0; i < batch; i++) {
+				randomEngines[i].seed(seed, first + i + 1);
+			}
+
+			atom->sampleStates(randomEngines.data(), batch, states + first * stateSize);
+		}
+
+		delete atom;
+	};
+
+	vector<thread> pool;
+	for (int w = 1; w < threads; w++) {
+		pool.push_back(thread(work));
+	}
+
+	work();
+
+	for (thread &t : pool) {
+		t.join();
+	}
+
+	msync(mapping, fileSize, MS_SYNC);
+	munmap(mapping, fileSize);
+	::close(descriptor);
+}
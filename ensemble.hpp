@@ -0,0 +1,52 @@
+#ifndef ENSEMBLE_HPP
+#define ENSEMBLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "atom.hpp"
+
+// Precomputed initial states of a target atom, e.g. "AP-H" (Abrines-Percival hydrogen) or "KW-He"
+// (Kirschbaum-Wilets helium). The states are stored as plain doubles (Atom::getState()) behind a
+// short header, so a mapped ensemble is used in place without parsing.
+class TargetEnsemble {
+
+	int descriptor = -1;
+	const char* data = nullptr;
+	std::size_t fileSize = 0;
+	std::size_t headerSize = 0;
+
+	std::string target;
+	std::size_t stateSize = 0;
+	uint64_t count = 0;
+	uint64_t seed = 0;
+
+public:
+
+	explicit TargetEnsemble(const std::string &fileName);
+	TargetEnsemble(const TargetEnsemble&) = delete;
+	TargetEnsemble& operator=(const TargetEnsemble&) = delete;
+
+	const std::string& getTarget() const;
+	std::size_t getStateSize() const;
+	uint64_t getSeed() const;
+	std::size_t size() const;
+
+	const double* state(std::size_t index) const;
+
+	// State drawn for a round of a campaign: consecutive rounds take consecutive states from an offset
+	// given by the campaign seed, so reruns with the same seed meet the same targets.
+	const double* draw(uint64_t campaignSeed, int round) const;
+
+	~TargetEnsemble();
+
+	// Creates the target atom of the given name in the system, nullptr for unknown targets.
+	static Atom* createTarget(const std::string &target, System* system);
+
+	// Generates count states of the target into the file, state i from the random stream (seed, i + 1).
+	static void generate(const std::string &fileName, const std::string &target, uint64_t count, uint64_t seed,
+			int threads);
+};
+
+#endif /* ENSEMBLE_HPP */
@@ -1,30 +1,320 @@
+#include <atomic>
 #include <boost/program_options.hpp>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
 #include <vector>
 
+#include "campaign.hpp"
 #include "experiment.hpp"
+#include "flight-recorder.hpp"
+#include "ground-states.hpp"
+#include "record.hpp"
 #include "experiments/collision-h-proton.hpp"
 #include "experiments/collision-he-proton.hpp"
+#include "experiments/collision-scenario.hpp"
 #include "experiments/helium-ap.hpp"
 #include "experiments/helium-kw.hpp"
 #include "experiments/sandbox.hpp"
 
 namespace po = boost::program_options;
 
+Experiment* createExperiment(const string &name, double b2max, double energy) {
+
+	if (name == "sb") {
+		std::cout << "Carry out sandbox experiment." << std::endl;
+		return new SandboxExperiment();
+
+	} else if (name == "p+H") {
+		std::cout << "Carry out proton + hidrogen collision experiment." << std::endl;
+		return new CollisionAbrinesPercivalHydrogenWithProton(b2max, energy, 1e-9, 1e-9, 1e-6);
+
+	} else if (name == "p+He") {
+		std::cout << "Carry out proton + helium collision experiment." << std::endl;
+		return new CollisionKirschbaumWiletsHeliumWithProton(b2max, energy, 1e-8, 1e-8, 1e-6);
+
+	} else if (name == "apHe") {
+		std::cout << "Carry out Abrines-Percival helium experiment." << std::endl;
+		return new AbrinesPercivalHeliumExperiment();
+
+	} else if (name == "kwHe") {
+		std::cout << "Carry out Kirschbaum-Wilets helium experiment." << std::endl;
+		return new KirschbaumWiletsHeliumExperiment();
+	}
+
+	return nullptr;
+}
+
+bool isBuiltIn(const string &name) {
+	return name == "sb" || name == "p+H" || name == "p+He" || name == "apHe" || name == "kwHe";
+}
+
+// A point of a campaign: the built-in experiment of the scenario or the generic collision experiment.
+Experiment* createExperiment(const CollisionScenario &scenario, size_t energy) {
+	if (!scenario.experiment.empty())
+		return createExperiment(scenario.experiment, scenario.getB2max(energy), scenario.energies[energy]);
+
+	std::cout << "Carry out " << scenario.name << " collision scenario." << std::endl;
+	return new CollisionScenarioExperiment(scenario, scenario.getB2max(energy), scenario.energies[energy]);
+}
+
+// The tallies of generic scenarios are merged with the campaign file, which describes their experiments.
+int mergeTallies(vector<string> fileNames, const string &campaignFileName) {
+	if (fileNames.empty()) {
+		std::cout << "No tally files to merge." << std::endl;
+		return 1;
+	}
+
+	vector<CollisionScenario> scenarios;
+	if (!campaignFileName.empty()) {
+		try {
+			scenarios = readCampaign(campaignFileName);
+		} catch (const exception &e) {
+			std::cout << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	Tally tally;
+	vector<bool> shardsSeen;
+
+	for (string fileName : fileNames) {
+		Tally part;
+		try {
+			part = Tally::read(fileName);
+		} catch (const exception &e) {
+			std::cout << e.what() << std::endl;
+			return 1;
+		}
+
+		if (shardsSeen.empty()) {
+			tally = part;
+			tally.reset();
+			shardsSeen.resize(part.shards, false);
+		} else if (!tally.isCompatible(part)) {
+			std::cout << fileName << " belongs to a different campaign." << std::endl;
+			return 1;
+		}
+
+		if (part.shard < 1 || part.shard > part.shards || shardsSeen[part.shard - 1]) {
+			std::cout << fileName << " holds a duplicate or invalid shard " << part.shard << "/"
+					<< part.shards << "." << std::endl;
+			return 1;
+		}
+
+		shardsSeen[part.shard - 1] = true;
+		tally.add(part);
+	}
+
+	// Scenarios the campaign file holds may describe targets the models cannot set up.
+	Experiment* experiment = nullptr;
+	try {
+		for (const CollisionScenario &scenario : scenarios) {
+			if (scenario.experiment.empty() && scenario.name == tally.experiment)
+				experiment = new CollisionScenarioExperiment(scenario, tally.b2max, tally.energy);
+		}
+
+		if (experiment == nullptr)
+			experiment = createExperiment(tally.experiment, tally.b2max, tally.energy);
+	} catch (const exception &e) {
+		std::cout << e.what() << std::endl;
+		return 1;
+	}
+
+	if (experiment == nullptr) {
+		std::cout << "Unknown experiment: " << tally.experiment << std::endl;
+		if (campaignFileName.empty())
+			std::cout << "Give the campaign file of a scenario with --campaign." << std::endl;
+		return 1;
+	}
+
+	std::cout << "Merged " << fileNames.size() << " of " << tally.shards << " shards (seed " << tally.seed
+			<< ", " << tally.rounds << " rounds)." << std::endl;
+
+	for (int s = 0; s < tally.shards; s++) {
+		if (!shardsSeen[s])
+			std::cout << "Shard " << (s + 1) << "/" << tally.shards << " is missing." << std::endl;
+	}
+
+	std::cout << std::endl;
+	experiment->report(tally);
+
+	std::cout << tally.successful << " rounds passed." << std::endl;
+	if (tally.failed != 0)
+		std::cout << tally.failed << " rounds failed." << std::endl;
+
+	delete experiment;
+	return 0;
+}
+
+// Prints a flight recording as CSV: the round, then a line per sample.
+void dumpFlight(const string &fileName) {
+	vector<double> samples;
+	FlightHeader flight = FlightRecorder::read(fileName, samples);
+
+	std::cout << "round " << flight.round << ", b " << flight.impactParameter << ", outcome " << flight.outcome
+			<< std::endl;
+	std::cout << "time";
+	for (uint32_t c = 0; c < flight.phaseLength; c++) {
+		std::cout << ",x" << c;
+	}
+	std::cout << std::endl;
+
+	for (uint32_t i = 0; i < flight.samples; i++) {
+		const double* sample = samples.data() + (size_t) i * (1 + flight.phaseLength);
+		std::cout << sample[0];
+		for (uint32_t c = 0; c < flight.phaseLength; c++) {
+			std::cout << "," << sample[1 + c];
+		}
+		std::cout << std::endl;
+	}
+}
+
+// Prints a result store as CSV, or the counts of its outcomes.
+void dumpStore(const string &fileName, bool summary) {
+	RecordReader reader(fileName);
+	const RecordHeader &header = reader.getHeader();
+
+	if (summary) {
+		map<int32_t, long> outcomes;
+		map<int32_t, long> tiers;
+		uint64_t evaluations = 0;
+		long extensions = 0;
+
+		for (size_t i = 0; i < reader.size(); i++) {
+			outcomes[reader.outcome(i)]++;
+			evaluations += reader.evaluations(i);
+			extensions += reader.extensions(i);
+			if (reader.tier(i) > 0)
+				tiers[reader.tier(i)]++;
+		}
+
+		std::cout << fileName << ": " << header.experiment << ", b2max " << header.b2max << ", energy "
+				<< header.energy << ", seed " << header.seed << ", " << reader.size() << " rounds" << std::endl;
+		for (auto outcome : outcomes) {
+			std::cout << "\t" << header.outcomeName(outcome.first) << ": " << outcome.second << std::endl;
+		}
+		std::cout << "\tExtended runs: " << extensions << std::endl;
+		for (auto tier : tiers) {
+			std::cout << "\tRetried at tier " << tier.first << ": " << tier.second << std::endl;
+		}
+		std::cout << "\tEvaluations per round: " << ((double) evaluations) / max((size_t) 1, reader.size())
+				<< std::endl;
+		return;
+	}
+
+	std::cout << "round,b,outcome,time,energy error,evaluations,extensions,tier";
+	for (uint32_t c = 0; c < header.phaseLength; c++) {
+		std::cout << ",x" << c;
+	}
+	std::cout << std::endl;
+
+	for (size_t i = 0; i < reader.size(); i++) {
+		std::cout << reader.round(i) << "," << reader.impactParameter(i) << ","
+				<< header.outcomeName(reader.outcome(i)) << "," << reader.endTime(i) << ","
+				<< reader.energyError(i) << "," << reader.evaluations(i) << "," << reader.extensions(i) << ","
+				<< reader.tier(i);
+
+		const double* phase = reader.initialPhase(i);
+		for (uint32_t c = 0; c < header.phaseLength; c++) {
+			std::cout << "," << phase[c];
+		}
+		std::cout << std::endl;
+	}
+}
+
+int dumpRecords(vector<string> fileNames, bool summary) {
+	std::cout.precision(10);
+
+	int result = 0;
+	for (string fileName : fileNames) {
+		try {
+			if (fileName.size() > 4 && fileName.substr(fileName.size() - 4) == ".bbf")
+				dumpFlight(fileName);
+			else
+				dumpStore(fileName, summary);
+		} catch (const exception &e) {
+			std::cout << e.what() << std::endl;
+			result = 1;
+		}
+	}
+
+	return result;
+}
+
 int main(int argc, char* argv[]) {
 
 	po::options_description desc("Allowed options");
 	desc.add_options()
 	    ("help,h", "Produce this help message")
-	    ("name,n", po::value<std::string>(), "Experiment to carry out")
+	    ("name,n", po::value<std::string>(),
+	    		"Experiment to carry out, 'campaign' to carry out the scenarios of campaign files, 'merge' to merge "
+	    		"tally files, 'dump' to convert result stores to CSV, 'ensemble' to generate target states or "
+	    		"'ground-states' to optimize Kirschbaum-Wilets atoms")
 	    ("random,r", "Use real random numbers")
+	    ("seed,s", po::value<uint64_t>(), "Campaign random seed")
 	    ("track,t", po::value<std::vector<int>>(), "MC iteration to track")
 	    ("iterations,i", po::value<int>(), "Number of MC iterations to do")
-	    ("b2max,b", po::value<double>(), "Maximal impact parameter square [au]")
-	    ("energy,e", po::value<double>(), "Projectile energy [keV]")
+	    ("b2max,b", po::value<std::string>(), "Maximal impact parameter square [au], one value or one per energy")
+	    ("energy,e", po::value<std::string>(),
+	    		"Projectile energy [keV]: a value, a list 'e1,e2,...' or a range 'start:stop:step'")
+	    ("threads,j", po::value<int>(), "Number of worker threads")
+	    ("shard", po::value<std::string>(), "Carry out only the i-th of N slices of the rounds (i/N)")
+	    ("tally", po::value<std::string>(), "Write the raw outcome tally to this file")
+	    ("checkpoint", po::value<std::string>(), "Periodically save the campaign state to this file")
+	    ("checkpoint-rounds", po::value<int>(), "Rounds between checkpoints (default 1000)")
+	    ("checkpoint-seconds", po::value<int>(), "Seconds between checkpoints (default 600)")
+	    ("resume", "Continue the campaign from its last checkpoint")
+	    ("flush-seconds", po::value<double>(), "Seconds between flushes of the result store (default 5)")
+	    ("strata", po::value<int>(), "Stratify the impact parameter into this many shells of equal b² width")
+	    ("pilot", po::value<int>(), "Pilot rounds of the stratified sampling (default a tenth of the rounds)")
+	    ("target-rel-error", po::value<double>(),
+	    		"Run until the relative standard error of the cross sections falls below this, the iterations "
+	    		"being the budget")
+	    ("channel", po::value<std::vector<std::string>>(), "Channel whose error is targeted (default all)")
+	    ("batch", po::value<int>(), "Rounds between convergence checks (default 1000)")
+	    ("time-limit", po::value<double>(), "Stop starting new batches after this many seconds")
+	    ("ensemble", po::value<std::string>(), "Target ensemble file to draw the target states from")
+	    ("target", po::value<std::string>(), "Target of a generated ensemble: AP-H, AP-He or KW-He")
+	    ("ground-states", po::value<std::string>(),
+	    		"Kirschbaum-Wilets ground-state cache to load, or to write with 'ground-states' (random starts "
+	    		"per element: --iterations)")
+	    ("approach-radius", po::value<double>(),
+	    		"Advance the target analytically until the projectile comes this close to it [au]")
+	    ("regularize", "Integrate the electron-nucleus pair in Kustaanheimo-Stiefel coordinates (p+H)")
+	    ("multirate", po::value<double>(),
+	    		"Integrate the projectile interactions on outer steps of this fraction of its time scale (e.g. 0.05)")
+	    ("fused", "Evaluate the forces in one kernel compiled for the interactions of the experiment")
+	    ("lockstep", "Integrate several rounds at once on the vector units (p+H, p+He)")
+	    ("tolerance-scale", po::value<double>(),
+	    		"Multiply the stepper tolerances of the experiment by this (e.g. 100, with --retries)")
+	    ("retries", po::value<int>(),
+	    		"Integrate failed rounds again from the same initial conditions up to this many times, at "
+	    		"tighter tolerances on the plain integrator")
+	    ("retry-factor", po::value<double>(), "Factor of the tolerances from one retry to the next (default 0.1)")
+	    ("straight-line", "Move the projectile on a straight line at constant velocity (high energies)")
+	    ("predict-outcomes", po::value<double>(),
+	    		"Decide electrons bound to both centers after the collision from their Kepler orbits, with this "
+	    		"safety factor on the apocenter and the speed (e.g. 1.5)")
+	    ("flight-record", po::value<std::string>(),
+	    		"Write the recent trajectory of the rounds with these outcomes to flight-<round>.bbf: a list of "
+	    		"outcome codes, channel names or 'failed'")
+	    ("flight-samples", po::value<int>(), "Samples kept by the flight recorder (default 256)")
+	    ("flight-interval", po::value<double>(), "Time between the samples of the flight recorder [au] (default 1)")
+	    ("files", po::value<std::vector<std::string>>(),
+	    		"Campaign files to carry out, tally files to merge, or result stores and flight recordings to dump")
+	    ("summary", "Dump only the outcome counts of result stores")
+	    ("campaign", po::value<std::string>(), "Campaign file of the scenarios whose tallies are merged")
 	;
 
 	po::positional_options_description p;
-	p.add("name", -1);
+	p.add("name", 1);
+	p.add("files", -1);
 
 	po::variables_map vm;
 	po::store(po::command_line_parser(argc, argv).options(desc).positional(p).run(), vm);
@@ -35,53 +325,280 @@ int main(int argc, char* argv[]) {
 		return 1;
 	}
 
+	if (vm.count("name") && vm["name"].as<string>() == "merge") {
+		vector<string> files;
+		if (vm.count("files"))
+			files = vm["files"].as<std::vector<std::string>>();
+		return mergeTallies(files, vm.count("campaign") ? vm["campaign"].as<string>() : "");
+	}
+
+	if (vm.count("name") && vm["name"].as<string>() == "dump") {
+		vector<string> files;
+		if (vm.count("files"))
+			files = vm["files"].as<std::vector<std::string>>();
+		return dumpRecords(files, vm.count("summary"));
+	}
+
+	if (vm.count("name") && vm["name"].as<string>() == "ensemble") {
+		if (!vm.count("target") || !vm.count("ensemble") || !vm.count("iterations")) {
+			std::cout << "Generating an ensemble needs --target, --ensemble and --iterations." << std::endl;
+			return 1;
+		}
+
+		if (vm["iterations"].as<int>() <= 0) {
+			std::cout << "An ensemble needs a positive number of --iterations." << std::endl;
+			return 1;
+		}
+
+		try {
+			uint64_t seed = vm.count("seed") ? vm["seed"].as<uint64_t>() : RandomEngine::default_seed;
+			int threads = vm.count("threads") ? vm["threads"].as<int>() : 1;
+			TargetEnsemble::generate(vm["ensemble"].as<string>(), vm["target"].as<string>(),
+					vm["iterations"].as<int>(), seed, threads);
+		} catch (const exception &e) {
+			std::cout << e.what() << std::endl;
+			return 1;
+		}
+
+		std::cout << vm["iterations"].as<int>() << " states of " << vm["target"].as<string>() << " written to "
+				<< vm["ensemble"].as<string>() << "." << std::endl;
+		return 0;
+	}
+
+	if (vm.count("name") && vm["name"].as<string>() == "ground-states") {
+		if (!vm.count("ground-states")) {
+			std::cout << "Optimizing ground states needs the --ground-states file." << std::endl;
+			return 1;
+		}
+
+		try {
+			uint64_t seed = vm.count("seed") ? vm["seed"].as<uint64_t>() : RandomEngine::default_seed;
+			int threads = vm.count("threads") ? vm["threads"].as<int>() : 1;
+			int starts = vm.count("iterations") ? vm["iterations"].as<int>() : 16;
+			GroundStateTable::generate(vm["ground-states"].as<string>(), starts, seed, threads);
+		} catch (const exception &e) {
+			std::cout << e.what() << std::endl;
+			return 1;
+		}
+
+		std::cout << "Ground states written to " << vm["ground-states"].as<string>() << "." << std::endl;
+		return 0;
+	}
+
+	if (vm.count("ground-states")) {
+		try {
+			GroundStateTable::getShared().load(vm["ground-states"].as<string>());
+		} catch (const exception &e) {
+			std::cout << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	unique_ptr<TargetEnsemble> ensemble;
+	if (vm.count("ensemble")) {
+		try {
+			ensemble.reset(new TargetEnsemble(vm["ensemble"].as<string>()));
+		} catch (const exception &e) {
+			std::cout << e.what() << std::endl;
+			return 1;
+		}
+	}
+
 	int iterations = 1;
 	if (vm.count("iterations"))
 		iterations = vm["iterations"].as<int>();
+	else if (vm.count("target-rel-error"))
+		iterations = 100000000;
 
-	double b2max = 0;
-	if (vm.count("b2max"))
-		b2max = vm["b2max"].as<double>();
+	vector<double> energies = { 0.0 };
+	if (vm.count("energy") && !parseValues(vm["energy"].as<string>(), energies)) {
+		std::cout << "Invalid energy: " << vm["energy"].as<string>() << std::endl;
+		return 1;
+	}
 
-	double energy = 0;
-	if (vm.count("energy"))
-		energy = vm["energy"].as<double>();
+	vector<double> b2maxes = { 0.0 };
+	if (vm.count("b2max") && !parseValues(vm["b2max"].as<string>(), b2maxes)) {
+		std::cout << "Invalid b2max: " << vm["b2max"].as<string>() << std::endl;
+		return 1;
+	}
 
-	Experiment* experiment = nullptr;
-	if (vm.count("name")) {
+	if (b2maxes.size() != 1 && b2maxes.size() != energies.size()) {
+		std::cout << "Give one b2max or one for every energy." << std::endl;
+		return 1;
+	}
+
+	// A sweep carries out one experiment for every energy, a campaign one for every energy of its scenarios.
+	// Points of several experiments write their files side by side, e.g. result-50keV.bbr.
+	vector<Experiment*> experiments;
+	vector<string> labels;
+	if (vm.count("name") && vm["name"].as<string>() == "campaign") {
+		if (!vm.count("files")) {
+			std::cout << "A campaign needs its campaign files." << std::endl;
+			return 1;
+		}
+
+		try {
+			// Scenarios label their output files and name the experiments of their tallies.
+			set<string> names;
+			for (const string &fileName : vm["files"].as<std::vector<std::string>>()) {
+				for (const CollisionScenario &scenario : readCampaign(fileName)) {
+					if (!names.insert(scenario.name).second)
+						throw runtime_error("Scenario " + scenario.name + " of " + fileName + " is defined twice.");
+					if (scenario.experiment.empty() && isBuiltIn(scenario.name))
+						throw runtime_error("Scenario " + scenario.name + " of " + fileName
+								+ " is named like a built-in experiment.");
 
-		if (vm["name"].as<string>() == "sb") {
-			std::cout << "Carry out sandbox experiment." << std::endl;
-			experiment = new SandboxExperiment();
+					for (size_t e = 0; e < scenario.energies.size(); e++) {
+						Experiment* experiment = createExperiment(scenario, e);
+						if (experiment == nullptr)
+							throw runtime_error("Unknown experiment " + scenario.experiment + " of scenario "
+									+ scenario.name + ".");
 
-		} else if (vm["name"].as<string>() == "p+H") {
-			std::cout << "Carry out proton + hidrogen collision experiment." << std::endl;
-			experiment = new CollisionAbrinesPercivalHydrogenWithProton(b2max, energy, 1e-9, 1e-9, 1e-6);
+						experiments.push_back(experiment);
+						ostringstream label;
+						label << scenario.name << "-" << scenario.energies[e] << "keV";
+						labels.push_back(label.str());
+					}
+				}
+			}
+		} catch (const exception &e) {
+			std::cout << e.what() << std::endl;
+			for (Experiment* experiment : experiments) {
+				delete experiment;
+			}
+			return 1;
+		}
+	} else {
+		for (size_t e = 0; e < energies.size(); e++) {
+			if (!vm.count("name"))
+				break;
 
-		} else if (vm["name"].as<string>() == "p+He") {
-			std::cout << "Carry out proton + helium collision experiment." << std::endl;
-			experiment = new CollisionKirschbaumWiletsHeliumWithProton(b2max, energy, 1e-8, 1e-8, 1e-6);
+			double b2max = b2maxes.size() == 1 ? b2maxes[0] : b2maxes[e];
+			Experiment* experiment = createExperiment(vm["name"].as<string>(), b2max, energies[e]);
+			if (experiment == nullptr)
+				break;
 
-		} else if (vm["name"].as<string>() == "apHe") {
-			std::cout << "Carry out Abrines-Percival helium experiment." << std::endl;
-			experiment = new AbrinesPercivalHeliumExperiment();
+			experiments.push_back(experiment);
+			ostringstream label;
+			label << energies[e] << "keV";
+			labels.push_back(label.str());
+		}
 
-		} else if (vm["name"].as<string>() == "kwHe") {
-			std::cout << "Carry out Kirschbaum-Wilets helium experiment." << std::endl;
-			experiment = new KirschbaumWiletsHeliumExperiment();
+		if (experiments.size() != energies.size()) {
+			std::cout << "No experiment chosen." << std::endl;
+			return 1;
 		}
 	}
 
-	if (experiment == nullptr) {
-		std::cout << "No experiment chosen." << std::endl;
-		return 1;
+	for (size_t e = 0; e < experiments.size(); e++) {
+		Experiment* experiment = experiments[e];
+
+		if (vm.count("threads"))
+			experiment->setThreads(vm["threads"].as<int>());
+
+		if (vm.count("seed"))
+			experiment->setSeed(vm["seed"].as<uint64_t>());
+
+		if (vm.count("shard")) {
+			int shard = 0, shards = 0;
+			char separator = 0;
+			istringstream shardStream(vm["shard"].as<string>());
+			shardStream >> shard >> separator >> shards;
+
+			if (!shardStream || separator != '/' || shard < 1 || shard > shards) {
+				std::cout << "Invalid shard: " << vm["shard"].as<string>() << std::endl;
+				return 1;
+			}
+
+			experiment->setShard(shard, shards);
+			experiment->setTallyFile("shard-" + to_string(shard) + "-of-" + to_string(shards) + ".tally");
+		}
+
+		if (vm.count("tally"))
+			experiment->setTallyFile(vm["tally"].as<string>());
+
+		if (vm.count("checkpoint")) {
+			int everyRounds = vm.count("checkpoint-rounds") ? vm["checkpoint-rounds"].as<int>() : 1000;
+			int everySeconds = vm.count("checkpoint-seconds") ? vm["checkpoint-seconds"].as<int>() : 600;
+			experiment->setCheckpoint(vm["checkpoint"].as<string>(), everyRounds, everySeconds);
+		}
+
+		if (vm.count("flush-seconds"))
+			experiment->setFlushInterval(vm["flush-seconds"].as<double>());
+
+		if (vm.count("target-rel-error")) {
+			vector<string> channels;
+			if (vm.count("channel"))
+				channels = vm["channel"].as<std::vector<std::string>>();
+			experiment->setTarget(vm["target-rel-error"].as<double>(), channels,
+					vm.count("batch") ? vm["batch"].as<int>() : 1000);
+		}
+
+		if (vm.count("time-limit"))
+			experiment->setTimeLimit(vm["time-limit"].as<double>());
+
+		experiment->setEnsemble(ensemble.get());
+
+		if (vm.count("approach-radius"))
+			experiment->setApproachRadius(vm["approach-radius"].as<double>());
+
+		experiment->setRegularization(vm.count("regularize"));
+
+		if (vm.count("multirate"))
+			experiment->setMultirate(vm["multirate"].as<double>());
+
+		experiment->setFusedForces(vm.count("fused"));
+		experiment->setLockstep(vm.count("lockstep"));
+
+		if (vm.count("tolerance-scale"))
+			experiment->setToleranceScale(vm["tolerance-scale"].as<double>());
+
+		if (vm.count("retries"))
+			experiment->setRetries(vm["retries"].as<int>(),
+					vm.count("retry-factor") ? vm["retry-factor"].as<double>() : 0.1);
+
+		if (vm.count("predict-outcomes"))
+			experiment->setOutcomePrediction(vm["predict-outcomes"].as<double>());
+
+		experiment->setStraightLine(vm.count("straight-line"));
+
+		if (vm.count("flight-record")) {
+			vector<string> outcomes;
+			istringstream outcomeStream(vm["flight-record"].as<string>());
+			for (string outcome; getline(outcomeStream, outcome, ',');) {
+				outcomes.push_back(outcome);
+			}
+			experiment->setFlightRecorder(outcomes, vm.count("flight-samples") ? vm["flight-samples"].as<int>() : 256,
+					vm.count("flight-interval") ? vm["flight-interval"].as<double>() : 1.0);
+		}
+
+		if (vm.count("strata"))
+			experiment->setStrata(vm["strata"].as<int>(), vm.count("pilot") ? vm["pilot"].as<int>() : 0);
+
+		if (vm.count("resume")) {
+			if (!vm.count("checkpoint")) {
+				std::cout << "Resuming needs the --checkpoint file." << std::endl;
+				return 1;
+			}
+			experiment->setResume(true);
+		}
+
+		if (experiments.size() > 1)
+			experiment->setLabel(labels[e]);
 	}
 
+	int result;
 	if (vm.count("track")) {
-		return experiment->track(vm["track"].as<std::vector<int>>());
+		result = experiments.front()->track(vm["track"].as<std::vector<int>>());
 	} else {
-		return experiment->carryOut(iterations, vm.count("random"));
+		result = Experiment::sweep(experiments, iterations, vm.count("random") && !vm.count("seed"));
+	}
+
+	for (Experiment* experiment : experiments) {
+		delete experiment;
 	}
+
+	return result;
 }
 
 int Experiment::track(vector<int> roundsToTrack) {
@@ -90,67 +607,621 @@ int Experiment::track(vector<int> roundsToTrack) {
 }
 
 int Experiment::carryOut(int numberOfRounds, bool seedRandom, vector<int> roundsToTrack, bool skipUntracked) {
+	return sweep( { this }, numberOfRounds, seedRandom, roundsToTrack, skipUntracked);
+}
+
+// static
+int Experiment::sweep(vector<Experiment*> points, int numberOfRounds, bool seedRandom, vector<int> roundsToTrack,
+		bool skipUntracked) {
+
+	// Settings of the campaign are taken from the first point.
+	Experiment* first = points.front();
+	uint64_t seed = first->seed;
+	int shard = first->shard;
+	int shards = first->shards;
+	auto started = chrono::steady_clock::now();
+
+	vector<vector<size_t>> targets(points.size());
+	for (size_t p = 0; p < points.size(); p++) {
+		if (!points[p]->findTargetOutcomes(targets[p]))
+			return 1;
+	}
+
+	vector<Tally> checkpoints(points.size());
+	if (first->resuming) {
+		for (size_t p = 0; p < points.size(); p++) {
+			try {
+				checkpoints[p] = Tally::read(points[p]->checkpointFileName);
+			} catch (const exception &e) {
+				cout << "Failed to resume: " << e.what() << endl;
+				return 1;
+			}
+		}
+
+		seed = checkpoints.front().seed;
+		seedRandom = false;
+	}
 
 	if (seedRandom) {
 		random_device rdev { };
-		this->randomEngine.seed(rdev());
-	} else {
-		this->randomEngine.seed(mt19937_64::default_seed);
+		seed = (((uint64_t) rdev()) << 32) ^ rdev();
+	}
+
+	cout << "Random seed: " << seed << endl;
+
+	// A shard carries out a contiguous slice of the campaign. Rounds keep their campaign numbers,
+	// so the union of all shards draws exactly the random numbers of a single run.
+	int firstRound = (int) (((long) numberOfRounds * (shard - 1)) / shards);
+	int lastRound = (int) (((long) numberOfRounds * shard) / shards);
+
+	if (shards > 1)
+		cout << "Shard " << shard << "/" << shards << ": rounds " << (firstRound + 1) << " to " << lastRound
+				<< "." << endl;
+
+	for (size_t p = 0; p < points.size(); p++) {
+		Experiment* point = points[p];
+		point->seed = seed;
+		point->tally.seed = seed;
+		point->tally.rounds = numberOfRounds;
+		point->tally.shard = shard;
+		point->tally.shards = shards;
+		point->tally.cursor = firstRound;
+		point->tally.reset();
+
+		// The pilot takes the first rounds of the slice, a tenth of them unless set. Every shard runs a
+		// pilot and allocates on its own: merged, the strata are still estimated without bias, but
+		// the rounds are spread differently than in a single run.
+		if (point->strata > 0) {
+			int pilot = point->pilotRounds > 0 ? point->pilotRounds : (lastRound - firstRound) / 10;
+			point->tally.stratify(point->strata, max(pilot, point->strata));
+		}
+
+		if (first->resuming) {
+			if (!point->tally.isCompatible(checkpoints[p]) || point->tally.shard != checkpoints[p].shard) {
+				cout << "Checkpoint " << point->checkpointFileName << " belongs to a different campaign." << endl;
+				return 1;
+			}
+
+			point->tally = checkpoints[p];
+			cout << "Resuming " << point->checkpointFileName << " from round " << (point->tally.cursor + 1) << "."
+					<< endl;
+		}
+
+		int result = point->open(numberOfRounds, seedRandom);
+		if (result != 0) {
+			point->close(0);
+			cout << "Failed to open experiment. (" << result << ")" << endl;
+			return result;
+		}
+	}
+
+	// Every thread carries out the rounds of all points, each with its own copy of the point.
+	int threads = first->threads;
+	vector<vector<Experiment*>> workers(points.size());
+	for (size_t p = 0; p < points.size(); p++) {
+		workers[p].push_back(points[p]);
+	}
+
+	for (int w = 1; w < threads; w++) {
+		vector<Experiment*> spawned;
+		bool opened = true;
+		for (Experiment* point : points) {
+			Experiment* experiment = point->spawn();
+			if (experiment == nullptr) {
+				if (w == 1)
+					cout << "Experiment does not support threads, running on a single thread." << endl;
+				opened = false;
+				break;
+			}
+
+			experiment->worker = w;
+			static_cast<ExperimentSettings&>(*experiment) = *point;
+			experiment->tally.stratify(point->tally.strata, point->tally.pilot);
+			spawned.push_back(experiment);
+
+			int result = experiment->open(numberOfRounds, seedRandom);
+			if (result != 0) {
+				cout << "Failed to open worker " << w << ". (" << result << ")" << endl;
+				opened = false;
+				break;
+			}
+		}
+
+		if (!opened) {
+			for (Experiment* experiment : spawned) {
+				delete experiment;
+			}
+			break;
+		}
+
+		for (size_t p = 0; p < points.size(); p++) {
+			workers[p].push_back(spawned[p]);
+		}
 	}
 
-	int result = this->open(numberOfRounds, seedRandom);
-	if (result != 0) {
-		this->close(0);
-		cout << "Failed to open experiment. (" << result << ")" << endl;
-		return result;
+	// The campaign tally of a point only ever holds a contiguous prefix of rounds. Rounds finished out
+	// of order wait in pending until the rounds before them are done, so a checkpoint is always exact.
+	struct Campaign {
+		Tally tally;
+		map<int, Tally> pending;
+		int lastCheckpoint;
+		chrono::steady_clock::time_point lastCheckpointTime;
+	};
+
+	vector<Campaign> campaigns(points.size());
+	int startRound = lastRound;
+	long roundsToRun = 0;
+	for (size_t p = 0; p < points.size(); p++) {
+		campaigns[p].tally = points[p]->tally;
+		campaigns[p].lastCheckpoint = campaigns[p].tally.cursor;
+		campaigns[p].lastCheckpointTime = chrono::steady_clock::now();
+		startRound = min(startRound, campaigns[p].tally.cursor);
+		roundsToRun += lastRound - campaigns[p].tally.cursor;
 	}
 
-	int round = 0;
-	int successfulRounds = 0;
-	int displayed = 0;
+	// Jobs run round by round through all points, so the points advance together and a round of
+	// every point starts from the same random stream, i.e. the same target state.
+	int phaseStart = startRound;
+	long numberOfJobs = 0;
+	atomic<long> nextJob(0);
+	vector<char> active(points.size(), true);
+	mutex progressMutex;
+	long finishedRounds = 0;
+	long displayed = 0;
 	int star = 1;
 
-	for (round = 0; round < numberOfRounds; round++) {
+	// A job is a group of consecutive rounds of a point, as many as the experiment integrates in lockstep.
+	size_t lanes = first->getLanes();
+	int phaseEnd = startRound;
 
-		bool tracking = true;
-		if (find(roundsToTrack.begin(), roundsToTrack.end(), (round + 1)) == roundsToTrack.end())
-			tracking = false;
+	auto work = [&](size_t w) {
+		long job;
+		while ((job = nextJob++) < numberOfJobs) {
+			int groupStart = phaseStart + (int) (job / points.size()) * (int) lanes;
+			int groupEnd = min(phaseEnd, groupStart + (int) lanes);
+			size_t p = job % points.size();
+			Campaign &campaign = campaigns[p];
+			Experiment* experiment = workers[p][w];
 
-		result = this->run(round + 1, tracking, skipUntracked);
-		if (result != 0) {
-			cout << endl << "Round " << (round + 1) << " failed with: " << result << " ";
-		} else {
-			successfulRounds++;
+			if (!active[p])
+				continue;
+
+			auto isTracked = [&](int round) {
+				return find(roundsToTrack.begin(), roundsToTrack.end(), (round + 1)) != roundsToTrack.end();
+			};
+
+			if (lanes > 1 && !skipUntracked) {
+				vector<int> laneRounds, laneStrata;
+				for (int round = max(groupStart, points[p]->tally.cursor); round < groupEnd; round++) {
+					if (isTracked(round))
+						continue;
+					laneRounds.push_back(round + 1);
+					laneStrata.push_back(campaign.tally.stratumOf(round));
+				}
+
+				if (laneRounds.size() > 1)
+					experiment->integrateLanes(laneRounds, laneStrata);
+			}
+
+			for (int round = groupStart; round < groupEnd; round++) {
+				if (round < points[p]->tally.cursor)
+					continue;
+
+				bool tracking = isTracked(round);
+
+				// Every round draws from its own stream, independently of the rounds before it.
+				experiment->randomEngine.seed(seed, round + 1);
+				experiment->stratum = campaign.tally.stratumOf(round);
+				experiment->tally.reset();
+				int roundResult = experiment->run(round + 1, tracking, skipUntracked);
+
+				// Failed integrations are retried from the same initial conditions at tighter tolerances.
+				while ((roundResult == -1 || roundResult == -2) && experiment->retryTier < experiment->retryTiers) {
+					experiment->retryTier++;
+					experiment->randomEngine.seed(seed, round + 1);
+					experiment->tally.reset();
+					roundResult = experiment->run(round + 1, tracking, skipUntracked);
+				}
+
+				experiment->tally.retried = experiment->retryTier > 0 ? 1 : 0;
+				experiment->retryTier = 0;
+
+				lock_guard<mutex> lock(progressMutex);
+				if (roundResult != 0) {
+					cout << endl << "Round " << (round + 1) << " failed with: " << roundResult << " ";
+					experiment->tally.failed++;
+				} else {
+					experiment->tally.successful++;
+				}
+				experiment->tally.countInStratum(experiment->stratum);
+
+				campaign.pending[round] = experiment->tally;
+				while (!campaign.pending.empty() && campaign.pending.begin()->first == campaign.tally.cursor) {
+					campaign.tally.add(campaign.pending.begin()->second);
+					campaign.pending.erase(campaign.pending.begin());
+					campaign.tally.cursor++;
+				}
+
+				Experiment* point = points[p];
+				if (!point->checkpointFileName.empty() && campaign.tally.cursor > campaign.lastCheckpoint
+						&& (campaign.tally.cursor - campaign.lastCheckpoint >= point->checkpointRounds
+								|| chrono::steady_clock::now() - campaign.lastCheckpointTime
+										>= chrono::seconds(point->checkpointSeconds))) {
+					// The last checkpoint written stays valid; the next one is tried after the usual interval.
+					try {
+						point->writeCheckpoint(campaign.tally);
+					} catch (const exception &e) {
+						cout << endl << e.what() << " ";
+					}
+					campaign.lastCheckpoint = campaign.tally.cursor;
+					campaign.lastCheckpointTime = chrono::steady_clock::now();
+				}
+
+				finishedRounds++;
+				while (displayed < 100 * finishedRounds) {
+					if (star % 10 == 0)
+						cout << star / 10;
+					else
+						cout << "*";
+
+					cout.flush();
+					displayed += roundsToRun;
+					star++;
+				}
+			}
 		}
+	};
 
-		while (displayed < 100 * (round + 1)) {
-			if (star % 10 == 0)
-				cout << star / 10;
-			else
-				cout << "*";
+	auto runRounds = [&](int from, int to) {
+		if (from >= to)
+			return;
+
+		phaseStart = from;
+		phaseEnd = to;
+		numberOfJobs = (long) ((to - from + (int) lanes - 1) / (int) lanes) * points.size();
+		nextJob = 0;
+
+		vector<thread> pool;
+		for (size_t w = 1; w < workers.front().size(); w++) {
+			pool.push_back(thread(work, w));
+		}
+
+		work(0);
+
+		for (thread &t : pool) {
+			t.join();
+		}
+	};
+
+	// Stratified points need the outcome of their pilot before the rest of the rounds can be allocated.
+	int pilotEnd = startRound;
+	for (Campaign &campaign : campaigns) {
+		if (campaign.tally.strata > 0 && campaign.tally.allocation.empty())
+			pilotEnd = max(pilotEnd, min(lastRound, firstRound + campaign.tally.pilot));
+	}
+
+	runRounds(startRound, pilotEnd);
+
+	for (size_t p = 0; p < points.size(); p++) {
+		Tally &campaignTally = campaigns[p].tally;
+		if (campaignTally.strata > 0 && campaignTally.allocation.empty() && campaignTally.cursor < lastRound)
+			campaignTally.allocate(targets[p]);
+	}
+
+	// With a target error or a time limit the rounds run in batches. Convergence is only checked
+	// between batches, on whole prefixes of rounds, so the number of rounds does not depend on threads.
+	bool batched = first->targetRelativeError > 0.0 || first->timeLimit > 0.0;
+	int from = max(startRound, pilotEnd);
+	while (from < lastRound) {
+		bool running = false;
+		for (size_t p = 0; p < points.size(); p++) {
+			active[p] = !points[p]->isConverged(campaigns[p].tally);
+			running = running || active[p];
+		}
+
+		if (!running)
+			break;
 
-			cout.flush();
-			displayed += numberOfRounds;
-			star++;
+		if (first->timeLimit > 0.0
+				&& chrono::steady_clock::now() - started >= chrono::duration<double>(first->timeLimit)) {
+			cout << endl << "Time limit reached.";
+			break;
 		}
+
+		int to = batched ? min(lastRound, from + first->batchRounds) : lastRound;
+		runRounds(from, to);
+		from = to;
 	}
 
 	cout << endl;
-	result = this->close(successfulRounds);
 
-	cout << successfulRounds << " rounds passed." << endl;
+	// Points of a campaign may belong to several experiments, each point is named then.
+	bool mixed = false;
+	for (Experiment* point : points) {
+		mixed = mixed || point->tally.experiment != first->tally.experiment;
+	}
+
+	int result = 0;
+	for (size_t p = 0; p < points.size(); p++) {
+		Experiment* point = points[p];
+		for (size_t w = 1; w < workers[p].size(); w++) {
+			delete workers[p][w];
+		}
+
+		point->tally = campaigns[p].tally;
+		if (!point->checkpointFileName.empty()) {
+			try {
+				point->writeCheckpoint(point->tally);
+			} catch (const exception &e) {
+				cout << e.what() << endl;
+				result = 1;
+			}
+		}
+
+		if (mixed)
+			cout << point->tally.experiment << ", energy " << point->tally.energy << " keV, b2max "
+					<< point->tally.b2max << ":" << endl;
+		else if (points.size() > 1)
+			cout << "Energy " << point->tally.energy << " keV, b2max " << point->tally.b2max << ":" << endl;
+
+		int closed = point->close(point->tally.successful);
 
-	if (numberOfRounds != successfulRounds)
-		cout << numberOfRounds - successfulRounds << " rounds failed." << endl;
+		if (point->targetRelativeError > 0.0) {
+			if (point->isConverged(point->tally))
+				cout << "Target error reached";
+			else
+				cout << "Target error not reached";
+			cout << " after " << (point->tally.successful + point->tally.failed) << " rounds." << endl;
+		}
+
+		cout << point->tally.successful << " rounds passed." << endl;
+
+		if (point->tally.failed != 0)
+			cout << point->tally.failed << " rounds failed." << endl;
+
+		if (!point->tallyFileName.empty()) {
+			point->tally.write(point->tallyFileName);
+			cout << "Tally written to " << point->tallyFileName << "." << endl;
+		}
+
+		if (closed != 0) {
+			cout << "Failed to close experiment. (" << closed << ")" << endl;
+			result = closed;
+		}
+
+		cout << endl;
+	}
 
-	if (result != 0)
-		cout << "Failed to close experiment. (" << result << ")" << endl;
-	else
+	if (points.size() > 1)
+		printCrossSectionTable(points);
+
+	if (result == 0)
 		cout << "Experiment completed." << endl;
 
 	return result;
 }
 
+// static
+void Experiment::printCrossSectionTable(const vector<Experiment*> &points) {
+	// Points of a campaign have channels of their own, so consecutive points of one experiment share a table.
+	for (size_t first = 0, next; first < points.size(); first = next) {
+		const Tally &tally = points[first]->tally;
+		for (next = first + 1; next < points.size(); next++) {
+			if (points[next]->tally.experiment != tally.experiment)
+				break;
+		}
+
+		cout << "Cross sections with standard errors";
+		if (next - first < points.size())
+			cout << " of " << tally.experiment;
+		cout << ":" << endl;
+		cout << "energy [keV]\tb2max\trounds";
+		for (const CrossSection &crossSection : points[first]->getCrossSections(tally)) {
+			cout << "\t" << crossSection.channel;
+		}
+		cout << endl;
+
+		for (size_t p = first; p < next; p++) {
+			Experiment* point = points[p];
+			cout << point->tally.energy << "\t" << point->tally.b2max << "\t" << point->tally.successful;
+			for (const CrossSection &crossSection : point->getCrossSections(point->tally)) {
+				cout << "\t" << crossSection.value << " +- " << crossSection.error;
+			}
+			cout << endl;
+		}
+		cout << endl;
+	}
+}
+
+void Experiment::writeCheckpoint(const Tally &tally) {
+	// The result store has to hold every round the checkpoint counts.
+	flushResults();
+
+	// Written aside and renamed, so a killed job never leaves a truncated checkpoint behind.
+	string temporaryFileName = checkpointFileName + ".tmp";
+	tally.write(temporaryFileName);
+
+	if (rename(temporaryFileName.c_str(), checkpointFileName.c_str()) != 0)
+		throw runtime_error("Failed to write checkpoint " + checkpointFileName + ".");
+}
+
+Experiment* Experiment::spawn() const {
+	return nullptr;
+}
+
+size_t Experiment::getLanes() const {
+	return 1;
+}
+
+void Experiment::flushResults() {
+}
+
+void Experiment::integrateLanes(const vector<int> &rounds, const vector<int> &strata) {
+}
+
+void Experiment::report(const Tally &tally) const {
+}
+
+vector<CrossSection> Experiment::getCrossSections(const Tally &tally) const {
+	return {};
+}
+
+void Experiment::setThreads(int threads) {
+	this->threads = max(1, threads);
+}
+
+void Experiment::setSeed(uint64_t seed) {
+	this->seed = seed;
+}
+
+void Experiment::setShard(int shard, int shards) {
+	this->shard = shard;
+	this->shards = shards;
+}
+
+void Experiment::setTallyFile(string fileName) {
+	this->tallyFileName = fileName;
+}
+
+void Experiment::setCheckpoint(string fileName, int everyRounds, int everySeconds) {
+	this->checkpointFileName = fileName;
+	this->checkpointRounds = max(1, everyRounds);
+	this->checkpointSeconds = max(1, everySeconds);
+}
+
+void Experiment::setResume(bool resume) {
+	this->resuming = resume;
+}
+
+void Experiment::setFlushInterval(double seconds) {
+	this->flushSeconds = seconds;
+}
+
+void Experiment::setStrata(int strata, int pilotRounds) {
+	this->strata = max(0, strata);
+	this->pilotRounds = max(0, pilotRounds);
+}
+
+void Experiment::setTarget(double relativeError, vector<string> channels, int batchRounds) {
+	this->targetRelativeError = relativeError;
+	this->targetChannels = channels;
+	this->batchRounds = max(1, batchRounds);
+}
+
+void Experiment::setTimeLimit(double seconds) {
+	this->timeLimit = seconds;
+}
+
+bool Experiment::findTargetOutcomes(vector<size_t> &outcomes) const {
+	vector<CrossSection> crossSections = getCrossSections(tally);
+
+	outcomes.clear();
+	for (const string &channel : targetChannels) {
+		size_t c = 0;
+		while (c < crossSections.size() && crossSections[c].channel != channel) {
+			c++;
+		}
+
+		if (c == crossSections.size()) {
+			cout << "Unknown channel: " << channel << endl;
+			return false;
+		}
+
+		outcomes.push_back(c);
+	}
+
+	return true;
+}
+
+bool Experiment::isConverged(const Tally &tally) const {
+	if (targetRelativeError <= 0.0)
+		return false;
+
+	vector<size_t> outcomes;
+	findTargetOutcomes(outcomes);
+
+	vector<CrossSection> crossSections = getCrossSections(tally);
+	for (size_t c = 0; c < crossSections.size(); c++) {
+		if (!outcomes.empty() && find(outcomes.begin(), outcomes.end(), c) == outcomes.end())
+			continue;
+
+		// A channel without any reaction yet has no estimate of its error.
+		if (crossSections[c].value <= 0.0 || crossSections[c].error > targetRelativeError * crossSections[c].value)
+			return false;
+	}
+
+	return true;
+}
+
+void Experiment::setEnsemble(const TargetEnsemble* ensemble) {
+	this->ensemble = ensemble;
+}
+
+void Experiment::setApproachRadius(double radius) {
+	this->approachRadius = max(0.0, radius);
+}
+
+void Experiment::setRegularization(bool regularizing) {
+	this->regularizing = regularizing;
+}
+
+void Experiment::setMultirate(double stepFactor) {
+	this->multirateFactor = max(0.0, stepFactor);
+}
+
+void Experiment::setFusedForces(bool fusing) {
+	this->fusing = fusing;
+}
+
+void Experiment::setLockstep(bool lockstep) {
+	this->lockstep = lockstep;
+}
+
+void Experiment::setToleranceScale(double scale) {
+	if (scale > 0.0)
+		this->toleranceScale = scale;
+}
+
+void Experiment::setRetries(int tiers, double factor) {
+	this->retryTiers = max(0, tiers);
+	if (factor > 0.0 && factor < 1.0)
+		this->retryFactor = factor;
+}
+
+void Experiment::setOutcomePrediction(double margin) {
+	// Below 1 the bounds of the orbits would no longer hold.
+	this->predictionMargin = margin > 0.0 ? max(1.0, margin) : 0.0;
+}
+
+void Experiment::setStraightLine(bool straightLine) {
+	this->straightLine = straightLine;
+}
+
+void Experiment::setFlightRecorder(vector<string> outcomes, int samples, double interval) {
+	this->flightOutcomes = outcomes;
+	this->flightSamples = max(1, samples);
+	this->flightInterval = max(0.0, interval);
+}
+
+void Experiment::setLabel(string label) {
+	this->label = label;
+	if (!tallyFileName.empty())
+		tallyFileName = labeledFileName(tallyFileName);
+	if (!checkpointFileName.empty())
+		checkpointFileName = labeledFileName(checkpointFileName);
+}
+
+string Experiment::labeledFileName(const string &fileName) const {
+	if (label.empty())
+		return fileName;
+
+	size_t dot = fileName.rfind('.');
+	if (dot == string::npos)
+		return fileName + "-" + label;
+
+	return fileName.substr(0, dot) + "-" + label + fileName.substr(dot);
+}
+
 Experiment::~Experiment() {
 }
 
@@ -161,7 +1232,7 @@ double Utils::calculateAcceleratedVelocityInAU(double massAU, double chargeAU, d
 }
 
 // static
-bool Utils::isBound(System system, identifier body, identifier reference) {
+bool Utils::isBound(System &system, identifier body, identifier reference) {
 	double energy = system.getBodyKineticEnergyReferenced(body, reference);
 	energy += system.getPairPotentialEnergy(body, reference);
 	return (energy < 0.0);
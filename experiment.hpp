@@ -5,13 +5,85 @@
 #include <simulbody/simulator.hpp>
 #include <simulbody/interactions/coulomb.hpp>
 
+#include "ensemble.hpp"
+#include "random.hpp"
+#include "tally.hpp"
+
 using namespace simulbody;
 using namespace std;
 
-class Experiment {
+struct CrossSection {
+	string channel;
+	double value;
+	double error;
+	double low;			// 95 % confidence interval
+	double high;
+};
+
+// Settings of an experiment, given by its setters before it is carried out. The workers of a campaign
+// take them over as a whole from the experiment they are spawned from.
+struct ExperimentSettings {
+	uint64_t seed = RandomEngine::default_seed;
+	int threads = 1;
+
+	int shard = 1;
+	int shards = 1;
+	string tallyFileName;
+
+	string checkpointFileName;
+	int checkpointRounds = 1000;
+	int checkpointSeconds = 600;
+	bool resuming = false;
+
+	double flushSeconds = 5.0;
+
+	int strata = 0;
+	int pilotRounds = 0;
+
+	double targetRelativeError = 0.0;
+	vector<string> targetChannels;
+	double timeLimit = 0.0;
+	int batchRounds = 1000;
+
+	const TargetEnsemble* ensemble = nullptr;
+
+	double approachRadius = 0.0;
+	bool regularizing = false;
+	double multirateFactor = 0.0;
+	bool fusing = false;
+	bool lockstep = false;
+
+	double toleranceScale = 1.0;
+	int retryTiers = 0;
+	double retryFactor = 0.1;
+
+	double predictionMargin = 0.0;
+	bool straightLine = false;
+
+	vector<string> flightOutcomes;
+	size_t flightSamples = 256;
+	double flightInterval = 1.0;
+
+	string label;
+};
+
+class Experiment: protected ExperimentSettings {
 protected:
 
-	mt19937_64 randomEngine;
+	RandomEngine randomEngine;
+	int worker = 0;
+	int stratum = 0;			// impact parameter stratum of the current round
+	int retryTier = 0;			// tier of the current attempt of the round, 0 for the first
+
+	Tally tally;
+
+	void writeCheckpoint(const Tally &tally);
+	string labeledFileName(const string &fileName) const;
+
+	bool findTargetOutcomes(vector<size_t> &outcomes) const;
+	bool isConverged(const Tally &tally) const;
+
+	static void printCrossSectionTable(const vector<Experiment*> &points);
 
 public:
 
@@ -19,11 +91,87 @@ public:
 	virtual int run(int round, bool tracking, bool skipUntracked) = 0;
 	virtual int close(int successfulRounds) = 0;
 
+	// Creates an independent copy of the experiment for a worker thread.
+	// Experiments which return nullptr are carried out on a single thread.
+	virtual Experiment* spawn() const;
+
+	// Number of rounds the experiment integrates together in integrateLanes() before they are run.
+	virtual size_t getLanes() const;
+
+	// Integrates the given (untracked) rounds in lockstep; run() then takes up the state of its round.
+	// The rounds are drawn with the seed and strata given, as run() draws them.
+	virtual void integrateLanes(const vector<int> &rounds, const vector<int> &strata);
+
+	// Writes the results of all the rounds finished so far to disk and waits until they are.
+	virtual void flushResults();
+
+	// Prints the outcome report of a (possibly merged) tally.
+	virtual void report(const Tally &tally) const;
+	virtual vector<CrossSection> getCrossSections(const Tally &tally) const;
+
+	void setThreads(int threads);
+	void setSeed(uint64_t seed);
+	void setShard(int shard, int shards);
+	void setTallyFile(string fileName);
+	void setCheckpoint(string fileName, int everyRounds, int everySeconds);
+	void setResume(bool resume);
+	void setFlushInterval(double seconds);
+	void setStrata(int strata, int pilotRounds);
+
+	// Runs in batches until the relative error of the target channels (all if none) falls below the
+	// target, or the rounds or the time limit run out.
+	void setTarget(double relativeError, vector<string> channels, int batchRounds);
+	void setTimeLimit(double seconds);
+
+	// Draws the target states from a precomputed ensemble instead of sampling them every round.
+	void setEnsemble(const TargetEnsemble* ensemble);
+
+	// Advances the target analytically until the projectile comes within this distance of it (0: never).
+	void setApproachRadius(double radius);
+
+	// Integrates electron-nucleus pairs in Kustaanheimo-Stiefel coordinates where the experiment supports it.
+	void setRegularization(bool regularizing);
+
+	// Updates the projectile interactions on outer steps of this fraction of the projectile time scale (0: off).
+	void setMultirate(double stepFactor);
+
+	// Evaluates the forces in one kernel compiled for the interactions of the experiment, where supported.
+	void setFusedForces(bool fusing);
+
+	// Integrates several rounds at once across the lanes of the vector units, where supported.
+	void setLockstep(bool lockstep);
+
+	// Multiplies the stepper tolerances of the experiment by the scale.
+	void setToleranceScale(double scale);
+
+	// Integrates rounds which fail (distance not reached, energy error) again from the same initial
+	// conditions, up to the given number of tiers, each at the tolerances of the last times the factor.
+	void setRetries(int tiers, double factor);
+
+	// Decides the outcome of electrons still bound to several centers after the collision from their two-body
+	// orbits instead of integrating on, with the given safety factor on the orbits (0: off).
+	void setOutcomePrediction(double margin);
+
+	// Moves the projectile on its initial straight line at constant velocity, as an external field acting on
+	// the target, instead of integrating it as a body.
+	void setStraightLine(bool straightLine);
+
+	// Keeps the last samples of the trajectory of every round, at least interval apart, and writes them out
+	// for the rounds with the given outcomes: outcome codes, channel names or 'failed' (none: off).
+	void setFlightRecorder(vector<string> outcomes, int samples, double interval);
+
+	// Distinguishes the output files of one point of a sweep.
+	void setLabel(string label);
+
 	int track(vector<int> roundsToTrack);
 
 	int carryOut(int numberOfRounds, bool seedRandom = false, vector<int> roundsToTrack = { },
 			bool skipUntracked = false);
 
+	// Carries out the same campaign for several points (e.g. projectile energies) on a shared worker pool.
+	static int sweep(vector<Experiment*> points, int numberOfRounds, bool seedRandom = false,
+			vector<int> roundsToTrack = { }, bool skipUntracked = false);
+
 	virtual ~Experiment();
 };
 
@@ -31,7 +179,7 @@ struct Utils {
 
 	static double calculateAcceleratedVelocityInAU(double massAU, double chargeAU, double voltageKV);
 
-	static bool isBound(System system, identifier body, identifier reference);
+	static bool isBound(System &system, identifier body, identifier reference);
 
 	static constexpr unsigned int hash(const char *str, int offset = 0) {
 		return !str[offset] ? 5381 : (hash(str, offset + 1) * 33) ^ str[offset];
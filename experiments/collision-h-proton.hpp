@@ -1,54 +1,45 @@
 #ifndef COLLISION_H_PROTON_HPP
 #define COLLISION_H_PROTON_HPP
 
-#include <fstream>
 #include <boost/numeric/odeint.hpp>
+#include <optional>
 #include <simulbody/simulator.hpp>
 #include <simulbody/printer.hpp>
 
 
 #include "../abrines-percival.hpp"
-#include "../experiment.hpp"
+#include "../fused-forces.hpp"
+#include "../kustaanheimo-stiefel.hpp"
+#include "collision.hpp"
 
 using namespace std;
 
-class CollisionAbrinesPercivalHydrogenWithProton: public Experiment {
+class CollisionAbrinesPercivalHydrogenWithProton: public CollisionExperiment {
 
-	ofstream stream;
+	enum Channel {
+		Ionization, ElectronCapture
+	};
 
-	System bbsystem;
-	Printer* printer;
-	PositionPrintField printField;
-
-	identifier projectile;
 	AbrinesPercivalAtom* hydrogen;
 	DistanceCondition* condition;
 	Interaction* coulombProjectileElectron;
 	Interaction* coulombProjectileNucleus;
-
-	double b2max;
-	double projectileVelocity;
-	double absoluteStepperError;
-	double relativeStepperError;
-	double relativeEnergyError;
-
-	int ionization = 0;
-	int ecapture = 0;
-	int extended = 0;
+	KustaanheimoStiefelSimulator* regularizer;
+	FusedForces<3, false>* forces;
+	LockstepSimulator<3, false, lockstepLanes>* lanes;
+	BindingClassifier* binding;			// the electron against the nucleus and the projectile
 
 public:
 
 	CollisionAbrinesPercivalHydrogenWithProton(double impact2max, double energykeV,
 			double absoluteStepperError, double relativeStepperError, double relativeEnergyError)
-			: b2max(impact2max), absoluteStepperError(absoluteStepperError), relativeStepperError(
-					relativeStepperError), relativeEnergyError(relativeEnergyError) {
-
-		projectileVelocity = Utils::calculateAcceleratedVelocityInAU(Atom::protonMass, 1.0, energykeV);
+			: CollisionExperiment("p+H", { "Ionization", "El.Capture" }, 1.0, impact2max, energykeV,
+					absoluteStepperError, relativeStepperError, relativeEnergyError) {
 
-		projectile = bbsystem.createBody(Atom::protonMass);
 		hydrogen = new AbrinesPercivalAtom(&bbsystem, Element::H, 1.00782503207);
+		fastTarget = new AbrinesPercivalAtom(&fastSystem, Element::H, 1.00782503207);
+		targetName = "AP-H";
 		condition = new DistanceCondition(projectile, hydrogen->getNucleus(), 51.0);
-		printer = nullptr;
 
 		coulombProjectileElectron = new CoulombInteraction(-1.0, projectile, hydrogen->getElectron("1s1"));
 		coulombProjectileNucleus = new CoulombInteraction(hydrogen->getNucleusCharge(), projectile,
@@ -56,36 +47,73 @@ public:
 
 		bbsystem.addInteraction(coulombProjectileElectron);
 		bbsystem.addInteraction(coulombProjectileNucleus);
+
+		regularizer = new KustaanheimoStiefelSimulator(&bbsystem, hydrogen->getNucleus(), hydrogen->getElectron("1s1"),
+				projectile, -hydrogen->getNucleusCharge(), hydrogen->getNucleusCharge(), -1.0, absoluteStepperError,
+				relativeStepperError);
+
+		ForceTopology topology;
+		hydrogen->addForces(topology);
+		topology.addCoulomb(-1.0, projectile, hydrogen->getElectron("1s1"));
+		topology.addCoulomb(hydrogen->getNucleusCharge(), projectile, hydrogen->getNucleus());
+		forces = new FusedForces<3, false>(&bbsystem, topology, &counter->evaluations);
+		lanes = new LockstepSimulator<3, false, lockstepLanes>(&bbsystem, topology, absoluteStepperError,
+				relativeStepperError);
+		binding = new BindingClassifier(&bbsystem, topology, hydrogen->getElectrons(),
+				{ hydrogen->getNucleus(), projectile });
 	}
 
-	int open(int numberOfRounds, bool seedRandom) {
-		stream.open("result.csv");
-		stream.precision(10);
+	Experiment* spawn() const {
+		return adopt(new CollisionAbrinesPercivalHydrogenWithProton(b2max, projectileEnergy, absoluteStepperError,
+				relativeStepperError, relativeEnergyError));
+	}
 
-		return 0;
+	size_t getLanes() const override {
+		return regularizing ? 1 : CollisionExperiment::getLanes();
 	}
 
-	int run(int round, bool tracking, bool skipUntracked) {
-		runge_kutta_dopri5<Phase> stepper;
-		auto ctrdStepper = make_controlled(absoluteStepperError, relativeStepperError, stepper);
-		Simulator<decltype(ctrdStepper)> simulator(ctrdStepper, &bbsystem);
+	void integrateLanes(const vector<int> &rounds, const vector<int> &strata) override {
+		CollisionExperiment::integrateLanes(lanes, rounds, strata, hydrogen->getNucleus(), 51.0, 1.0, 100);
+	}
 
-		uniform_real_distribution<double> distributionNullB2Max(0, b2max);
-		double b = sqrt(distributionNullB2Max(randomEngine));
+	void prescribeProjectile() override {
+		forces->prescribe(projectile);
+		lanes->prescribe(projectile);
+	}
 
-		hydrogen->randomize(randomEngine);
+	void setUp(int round, double impactParameter) override {
+		prepareTarget(hydrogen, round);
 		hydrogen->setPosition(vector3D(0, 0, 0));
 		hydrogen->setVelocity(vector3D(0, 0, 0));
 
-		bbsystem.setBodyPosition(projectile, vector3D(0, b, -50.0));
+		bbsystem.setBodyPosition(projectile, vector3D(0, impactParameter, -50.0));
 		bbsystem.setBodyVelocity(projectile, vector3D(0, 0, projectileVelocity));
+	}
+
+	// The projectile and the unperturbed atom follow their exact paths until the approach radius.
+	double approach(double impactParameter) override {
+		double time = getApproachTime(impactParameter, 50.0);
+		if (time > 0.0) {
+			hydrogen->propagate(time);
+			bbsystem.setBodyPosition(projectile, vector3D(0, impactParameter, -50.0 + projectileVelocity * time));
+		}
+		return time;
+	}
+
+	int run(int round, bool tracking, bool skipUntracked) {
+		runge_kutta_dopri5<Phase> stepper;
+		auto ctrdStepper = make_controlled(getAbsoluteStepperError(), getRelativeStepperError(), stepper);
+		Simulator<decltype(ctrdStepper)> simulator(ctrdStepper, &bbsystem);
+		FusedSimulator<decltype(ctrdStepper), FusedForces<3, false>> fusedSimulator(ctrdStepper, *forces, &bbsystem);
+
+		double b = drawImpactParameter();
+		setUp(round, b);
 
 		if (skipUntracked && !tracking) {
 			return 0;
 		}
 
-		stream << bbsystem.phase;
-		stream.flush();
+		startRecord(round, b);
 
 		if (tracking) {
 			printer = new Printer(to_string(round) + ".csv");
@@ -94,75 +122,101 @@ public:
 		}
 
 		if (condition->evaluate(bbsystem.phase, 0)) {
-			stream << "\t" << "Initial condition error" << endl;
-			return -3;
+			return store(-3, 0.0, 0.0);
+		}
+
+		double time = approach(b);
+
+		double energy = getConservedEnergy();
+		// Tracked rounds stay on the plain simulator, where the printer sees every step, and so do retries.
+		// The regularized and multirate integrators move the projectile freely.
+		bool regularized = regularizing && !tracking && retryTier == 0 && !straightLine;
+		bool multirated = multirateFactor > 0.0 && !tracking && retryTier == 0 && !straightLine;
+		bool fused = fusing && !tracking;
+
+		// Built for the rounds that use it only, the others allocate nothing for it.
+		optional<MultirateSimulator<decltype(ctrdStepper)>> multirate;
+		if (multirated)
+			multirate.emplace(ctrdStepper, &bbsystem, &fastSystem, &counter->evaluations, &fastCounter->evaluations,
+					vector<Interaction*> { counter, coulombProjectileElectron, coulombProjectileNucleus }, projectile,
+					hydrogen->getBodies(), multirateFactor, getMultirateEnergyTolerance());
+
+		if (!takeLane(round, time)) {
+			if (regularized)
+				time = simulateRegularized(time, time + 100.0, 51.0);
+			else if (multirated)
+				time = multirate->simulate(time, time + 1.0, 0.0001, recorded(*condition), 100);
+			else if (fused)
+				time = fusedSimulator.simulate(time, time + 1.0, 0.0001, recorded(*condition), 100);
+			else
+				time = simulator.simulate(time, time + 1.0, 0.0001, recorded(*condition), 100);
 		}
 
-		double energy = bbsystem.getSystemEnergy();
-		double time = simulator.simulate(0.0, 1.0, 0.0001, *condition, 100);
 		bool eBoundToTarget;
 		bool eBoundToProjec;
 
 		while (true) {
 
+			sample(time);
+
 			if (time < 0.0) {
-				stream << "\t" << "Distance not reached error" << endl;
-				return -1;
+				return store(-1, time, energy);
 			}
 
-			if (abs((energy - bbsystem.getSystemEnergy()) / energy) > relativeEnergyError) {
-				stream << "\t" << "Energy error: " << energy << " vs. " << bbsystem.getSystemEnergy() << endl;
-				return -2;
+			if (isEnergyOff(energy)) {
+				return store(-2, time, energy);
 			}
 
-			eBoundToTarget = Utils::isBound(bbsystem, hydrogen->getElectron("1s1"), hydrogen->getNucleus());
-			eBoundToProjec = Utils::isBound(bbsystem, hydrogen->getElectron("1s1"), projectile);
+			BindingMatrix bindings = binding->classify(bbsystem.phase);
+			bool predicted = resolve(*binding, bindings);
+			eBoundToTarget = bindings.isBound(0, 0);
+			eBoundToProjec = bindings.isBound(0, 1);
 
 			if (!eBoundToTarget || !eBoundToProjec) {
+				if (predicted)
+					tally.predicted++;
 				break;
 			}
 
-			stream << " " << round << " Extend Run";
-			simulator.simulate(time, time + 1.0, 0.0001);
+			// Only the KS integration can fail within an interval.
+			if (regularized) {
+				if (simulateRegularized(time, time + 1.0) < 0.0)
+					return store(-1, -1.0, energy);
+			} else if (multirated) {
+				multirate->simulate(time, time + 1.0, 0.0001);
+			} else if (fused) {
+				fusedSimulator.simulate(time, time + 1.0, 0.0001);
+			} else {
+				simulator.simulate(time, time + 1.0, 0.0001);
+			}
+
 			time += 1.0;
-			extended++;
+			tally.extended++;
+			record.extensions++;
 		}
 
-		if (eBoundToTarget && !eBoundToProjec) {
-			stream << endl;
-		}
+		int32_t outcome = RoundRecord::noReaction;
 
 		if (!eBoundToTarget && eBoundToProjec) {
-			stream << "\t" << round << " --> Electron Capture" << endl;
-			ecapture++;
+			outcome = count(ElectronCapture);
 		}
 
 		if (!eBoundToTarget && !eBoundToProjec) {
-			stream << "\t" << round << " --> Ionization" << endl;
-			ionization++;
+			outcome = count(Ionization);
 		}
 
-		if (printer != nullptr)
-			delete printer;
-
-		stream.flush();
-		return 0;
+		return store(outcome, time, energy);
 	}
 
-	int close(int successfulRounds) {
-		double ionizationRate = ((double) ionization) / ((double) successfulRounds);
-		double ecaptureRate = ((double) ecapture) / ((double) successfulRounds);
-		double extendedRate = ((double) extended) / ((double) successfulRounds);
-		cout << "Ionization: " << ionization << " (" << ionizationRate * 100.0 << " %)" << endl;
-		cout << "El.Capture: " << ecapture << " (" << ecaptureRate * 100.0 << " %)" << endl;
-		cout << "Extended run: " << extended << " (" << extendedRate * 100.0 << " %)" << endl << endl;
-		cout << "Cross sections:" << endl;
-
-		cout << "\t Ionization: " << ionizationRate * M_PI * b2max << endl;
-		cout << "\t El.Capture: " << ecaptureRate * M_PI * b2max << endl << endl;
+private:
 
-		stream.close();
-		return 0;
+	// Integrates in KS coordinates, counting the evaluations with the others of the round.
+	double simulateRegularized(double time, double endTime, double distance = 0.0) {
+		regularizer->evaluations = 0;
+		regularizer->setTolerances(getAbsoluteStepperError(), getRelativeStepperError());
+		time = regularizer->simulate(time, endTime, distance);
+		counter->evaluations += regularizer->evaluations;
+		return time;
 	}
 };
 
@@ -1,59 +1,48 @@
 #ifndef COLLISION_HE_PROTON_HPP
 #define COLLISION_HE_PROTON_HPP
 
-#include <fstream>
 #include <boost/numeric/odeint.hpp>
+#include <optional>
 #include <simulbody/simulator.hpp>
 #include <simulbody/printer.hpp>
 
 
+#include "../fused-forces.hpp"
 #include "../kirschbaum-wilets.hpp"
-#include "../experiment.hpp"
+#include "collision.hpp"
 
 using namespace std;
 
-class CollisionKirschbaumWiletsHeliumWithProton: public Experiment {
+class CollisionKirschbaumWiletsHeliumWithProton: public CollisionExperiment {
 
-	ofstream stream;
+	enum Channel {
+		SingleIonization, DualIonization, SingleCapture, DualCapture, IonizationAndCapture
+	};
 
-	System bbsystem;
-	Printer* printer;
-	PositionPrintField printField;
-
-	identifier projectile;
 	KirschbaumWiletsAtom* helium;
 	Interaction* coulombProjectile1s1;
 	Interaction* coulombProjectile1s2;
 	Interaction* coulombProjectileNucleus;
 	Interaction* heisenbergProjectile1s1;
 	Interaction* heisenbergProjectile1s2;
+	FusedForces<4, true>* forces;
+	LockstepSimulator<4, true, lockstepLanes>* lanes;
+	BindingClassifier* binding;			// 1s1 and 1s2 against the nucleus and the projectile
 
-	double b2max;
 	double initialDistance = 50;
-	double projectileVelocity;
-	double absoluteStepperError;
-	double relativeStepperError;
-	double relativeEnergyError;
-
-	int ionization1 = 0;
-	int ionization2 = 0;
-	int ecapture1 = 0;
-	int ecapture2 = 0;
-	int ionizationAndCapture = 0;
-	int extended = 0;
 
 public:
 
+	// Cross sections are given in units of 1e-16 cm^2.
 	CollisionKirschbaumWiletsHeliumWithProton(double impact2max, double energykeV,
 			double absoluteStepperError, double relativeStepperError, double relativeEnergyError)
-			: b2max(impact2max), absoluteStepperError(absoluteStepperError), relativeStepperError(
-					relativeStepperError), relativeEnergyError(relativeEnergyError) {
-
-		projectileVelocity = Utils::calculateAcceleratedVelocityInAU(Atom::protonMass, 1.0, energykeV);
+			: CollisionExperiment("p+He", { "Single ionization", "Dual ionization", "Single el.Capture",
+					"Dual el.Capture", "Ionizat & Capture" }, 0.28003, impact2max, energykeV, absoluteStepperError,
+					relativeStepperError, relativeEnergyError) {
 
-		projectile = bbsystem.createBody(Atom::protonMass);
 		helium = new KirschbaumWiletsAtom(&bbsystem, Element::He, 4.00260325);
-		printer = nullptr;
+		fastTarget = new KirschbaumWiletsAtom(&fastSystem, Element::He, 4.00260325);
+		targetName = "KW-He";
 
 		coulombProjectile1s1 = new CoulombInteraction(-1.0, projectile, helium->getElectron("1s1"));
 		coulombProjectile1s2 = new CoulombInteraction(-1.0, projectile, helium->getElectron("1s2"));
@@ -68,29 +57,53 @@ public:
 		bbsystem.addInteraction(coulombProjectileNucleus);
 		bbsystem.addInteraction(heisenbergProjectile1s1);
 		bbsystem.addInteraction(heisenbergProjectile1s2);
-	}
 
-	int open(int numberOfRounds, bool seedRandom) {
-		stream.open("result.csv");
-		stream.precision(10);
+		ForceTopology topology;
+		helium->addForces(topology);
+		for (string orbit : { "1s1", "1s2" }) {
+			topology.addCoulomb(-1.0, projectile, helium->getElectron(orbit));
+			topology.addHeisenberg(45.0, 1.0, projectile, helium->getElectron(orbit));
+		}
+		topology.addCoulomb(helium->getNucleusCharge(), projectile, helium->getNucleus());
+		forces = new FusedForces<4, true>(&bbsystem, topology, &counter->evaluations);
+		lanes = new LockstepSimulator<4, true, lockstepLanes>(&bbsystem, topology, absoluteStepperError,
+				relativeStepperError);
+		binding = new BindingClassifier(&bbsystem, topology, helium->getElectrons(),
+				{ helium->getNucleus(), projectile });
+	}
 
-		return 0;
+	Experiment* spawn() const {
+		return adopt(new CollisionKirschbaumWiletsHeliumWithProton(b2max, projectileEnergy, absoluteStepperError,
+				relativeStepperError, relativeEnergyError));
 	}
 
-	int run(int round, bool tracking, bool skipUntracked) {
-		runge_kutta_dopri5<Phase> stepper;
-		auto ctrdStepper = make_controlled(absoluteStepperError, relativeStepperError, stepper);
-		Simulator<decltype(ctrdStepper)> simulator(ctrdStepper, &bbsystem);
+	void integrateLanes(const vector<int> &rounds, const vector<int> &strata) override {
+		CollisionExperiment::integrateLanes(lanes, rounds, strata, helium->getNucleus(), initialDistance + 1.0,
+				1.0, getMaxIntervals());
+	}
 
-		uniform_real_distribution<double> distributionNullB2Max(0, b2max);
-		double b = sqrt(distributionNullB2Max(randomEngine));
+	void prescribeProjectile() override {
+		forces->prescribe(projectile);
+		lanes->prescribe(projectile);
+	}
 
-		helium->randomize(randomEngine);
+	void setUp(int round, double impactParameter) override {
+		prepareTarget(helium, round);
 		helium->setPosition(vector3D(0, 0, 0));
 		helium->setVelocity(vector3D(0, 0, 0));
 
-		bbsystem.setBodyPosition(projectile, vector3D(0, b, -initialDistance));
+		bbsystem.setBodyPosition(projectile, vector3D(0, impactParameter, -initialDistance));
 		bbsystem.setBodyVelocity(projectile, vector3D(0, 0, projectileVelocity));
+	}
+
+	int run(int round, bool tracking, bool skipUntracked) {
+		runge_kutta_dopri5<Phase> stepper;
+		auto ctrdStepper = make_controlled(getAbsoluteStepperError(), getRelativeStepperError(), stepper);
+		Simulator<decltype(ctrdStepper)> simulator(ctrdStepper, &bbsystem);
+		FusedSimulator<decltype(ctrdStepper), FusedForces<4, true>> fusedSimulator(ctrdStepper, *forces, &bbsystem);
+
+		double b = drawImpactParameter();
+		setUp(round, b);
 
 		DistanceCondition condition(projectile, helium->getNucleus(), initialDistance + 1.0);
 
@@ -98,8 +111,7 @@ public:
 			return 0;
 		}
 
-		stream << bbsystem.phase;
-		stream.flush();
+		startRecord(round, b);
 
 		if (tracking) {
 			printer = new Printer(to_string(round) + ".csv");
@@ -108,41 +120,72 @@ public:
 		}
 
 		if (condition.evaluate(bbsystem.phase, 0)) {
-			stream << "\t" << "Initial condition error" << endl;
-			return -3;
+			return store(-3, 0.0, 0.0);
+		}
+
+		int maxRounds = getMaxIntervals();
+		double energy = getConservedEnergy();
+		// Tracked rounds stay on the plain simulator, where the printer sees every step, and so do retries.
+		// The multirate integrator moves the projectile freely.
+		bool multirated = multirateFactor > 0.0 && !tracking && retryTier == 0 && !straightLine;
+		bool fused = fusing && !tracking && !multirated;
+
+		// Built for the rounds that use it only, the others allocate nothing for it.
+		optional<MultirateSimulator<decltype(ctrdStepper)>> multirate;
+		if (multirated)
+			multirate.emplace(ctrdStepper, &bbsystem, &fastSystem, &counter->evaluations, &fastCounter->evaluations,
+					vector<Interaction*> { counter, coulombProjectile1s1, coulombProjectile1s2,
+							coulombProjectileNucleus, heisenbergProjectile1s1, heisenbergProjectile1s2 },
+					projectile, helium->getBodies(), multirateFactor, getMultirateEnergyTolerance());
+
+		double time;
+		if (!takeLane(round, time)) {
+			if (multirated)
+				time = multirate->simulate(0.0, 1.0, 0.0001, recorded(condition), maxRounds);
+			else if (fused)
+				time = fusedSimulator.simulate(0.0, 1.0, 0.0001, recorded(condition), maxRounds);
+			else
+				time = simulator.simulate(0.0, 1.0, 0.0001, recorded(condition), maxRounds);
 		}
 
-		int maxRounds = (int) (1.2 * (2.0 * initialDistance + 1.0) / projectileVelocity + 1.0);
-		double energy = bbsystem.getSystemEnergy();
-		double time = simulator.simulate(0.0, 1.0, 0.0001, condition, maxRounds);
 		bool e1s1BoundToTarget, e1s2BoundToTarget;
 		bool e1s1BoundToProjec, e1s2BoundToProjec;
 
 		while (true) {
 
+			sample(time);
+
 			if (time < 0.0) {
-				stream << "\t" << "Distance not reached error" << endl;
-				return -1;
+				return store(-1, time, energy);
 			}
 
-			if (abs((energy - bbsystem.getSystemEnergy()) / energy) > relativeEnergyError) {
-				stream << "\t" << "Energy error: " << energy << " vs. " << bbsystem.getSystemEnergy() << endl;
-				return -2;
+			if (isEnergyOff(energy)) {
+				return store(-2, time, energy);
 			}
 
-			e1s1BoundToTarget = Utils::isBound(bbsystem, helium->getElectron("1s1"), helium->getNucleus());
-			e1s2BoundToTarget = Utils::isBound(bbsystem, helium->getElectron("1s2"), helium->getNucleus());
-			e1s1BoundToProjec = Utils::isBound(bbsystem, helium->getElectron("1s1"), projectile);
-			e1s2BoundToProjec = Utils::isBound(bbsystem, helium->getElectron("1s2"), projectile);
+			BindingMatrix bindings = binding->classify(bbsystem.phase);
+			bool predicted = resolve(*binding, bindings);
+			e1s1BoundToTarget = bindings.isBound(0, 0);
+			e1s2BoundToTarget = bindings.isBound(1, 0);
+			e1s1BoundToProjec = bindings.isBound(0, 1);
+			e1s2BoundToProjec = bindings.isBound(1, 1);
 
 			if ((!e1s1BoundToTarget || !e1s1BoundToProjec) && (!e1s2BoundToTarget || !e1s2BoundToProjec)) {
+				if (predicted)
+					tally.predicted++;
 				break;
 			}
 
-			stream << " " << round << " Extend Run";
-			simulator.simulate(time, time + 1.0, 0.0001);
+			if (multirated)
+				multirate->simulate(time, time + 1.0, 0.0001);
+			else if (fused)
+				fusedSimulator.simulate(time, time + 1.0, 0.0001);
+			else
+				simulator.simulate(time, time + 1.0, 0.0001);
+
 			time += 1.0;
-			extended++;
+			tally.extended++;
+			record.extensions++;
 		}
 
 		string bindings;
@@ -153,68 +196,41 @@ public:
 				bindings.append("+");
 		}
 
+		int32_t outcome = RoundRecord::noReaction;
+
 		switch (Utils::hash(bindings.c_str())) {
 		case Utils::hash("--++"):
-			stream << endl;
 			break;
 		case Utils::hash("+-++"):
 		case Utils::hash("-+++"):
-			stream << "\t" << round << " --> Single Ionization" << endl;
-			ionization1++;
+			outcome = count(SingleIonization);
 			break;
 		case Utils::hash("++++"):
-			stream << "\t" << round << " --> Dual Ionization" << endl;
-			ionization2++;
+			outcome = count(DualIonization);
 			break;
 		case Utils::hash("+--+"):
 		case Utils::hash("-++-"):
-			stream << "\t" << round << " --> Single electron Capture" << endl;
-			ecapture1++;
+			outcome = count(SingleCapture);
 			break;
 		case Utils::hash("++--"):
-			stream << "\t" << round << " --> Dual electron Capture" << endl;
-			ecapture2++;
+			outcome = count(DualCapture);
 			break;
 		case Utils::hash("++-+"):
 		case Utils::hash("+++-"):
-			stream << "\t" << round << " --> Ionization And Capture" << endl;
-			ionizationAndCapture++;
+			outcome = count(IonizationAndCapture);
 			break;
 		default:
 			throw std::logic_error("Unhandled energy configuration.");
 		}
 
-		if (printer != nullptr)
-			delete printer;
-
-		stream.flush();
-		return 0;
+		return store(outcome, time, energy);
 	}
 
-	int close(int successfulRounds) {
-		double ionizationRate1 = ((double) ionization1) / ((double) successfulRounds);
-		double ionizationRate2 = ((double) ionization2) / ((double) successfulRounds);
-		double ecaptureRate1 = ((double) ecapture1) / ((double) successfulRounds);
-		double ecaptureRate2 = ((double) ecapture2) / ((double) successfulRounds);
-		double ionAndEcaptRate = ((double) ionizationAndCapture) / ((double) successfulRounds);
-		double extendedRate = ((double) extended) / ((double) successfulRounds);
-		cout << "Single ionization: " << ionization1 << " (" << ionizationRate1 * 100.0 << " %)" << endl;
-		cout << "Dual ionization  : " << ionization2 << " (" << ionizationRate2 * 100.0 << " %)" << endl;
-		cout << "Single el.Capture: " << ecapture1 << " (" << ecaptureRate1 * 100.0 << " %)" << endl;
-		cout << "Dual el.Capture  : " << ecapture2 << " (" << ecaptureRate2 * 100.0 << " %)" << endl;
-		cout << "Ionizat & Capture: " << ionizationAndCapture << " (" << ionAndEcaptRate * 100.0 << " %)"
-				<< endl;
-		cout << "Extended run: " << extended << " (" << extendedRate * 100.0 << " %)" << endl << endl;
-		cout << "Cross sections:" << endl;
-
-		cout << "\t Single ionization: " << ionizationRate1 * M_PI * b2max * 0.28003 << endl;
-		cout << "\t Dual ionization  : " << ionizationRate2 * M_PI * b2max * 0.28003 << endl;
-		cout << "\t Single el.Capture: " << ecaptureRate1 * M_PI * b2max * 0.28003 << endl;
-		cout << "\t Dual el.Capture  : " << ecaptureRate2 * M_PI * b2max * 0.28003 << endl;
-		cout << "\t Ionizat & Capture: " << ionAndEcaptRate * M_PI * b2max * 0.28003 << endl << endl;
-
-		stream.close();
-		return 0;
+private:
+
+	// Intervals of unit time the projectile gets to pass the atom.
+	int getMaxIntervals() const {
+		return (int) (1.2 * (2.0 * initialDistance + 1.0) / projectileVelocity + 1.0);
 	}
 };
 
@@ -0,0 +1,209 @@
+#ifndef COLLISION_SCENARIO_HPP
+#define COLLISION_SCENARIO_HPP
+
+#include <boost/numeric/odeint.hpp>
+#include <simulbody/simulator.hpp>
+#include <simulbody/printer.hpp>
+
+#include "../abrines-percival.hpp"
+#include "../campaign.hpp"
+#include "../ground-states.hpp"
+#include "../kirschbaum-wilets.hpp"
+#include "collision.hpp"
+
+using namespace std;
+
+// Collision of a bare projectile of any charge and mass with an Abrines-Percival or Kirschbaum-Wilets
+// atom, as a campaign scenario sets it up. The channels count the electrons the target loses, ionized
+// or captured by the projectile. It runs on the plain simulator: the force kernels, the lanes and the
+// regularized and multirate integrators are compiled for the bodies of the built-in experiments.
+class CollisionScenarioExperiment: public CollisionExperiment {
+
+	CollisionScenario scenario;
+	Atom* target;
+	BindingClassifier* binding;			// the electrons against the nucleus and the projectile
+
+	double initialDistance = 50;
+
+public:
+
+	// Cross sections are given in units of 1e-16 cm^2.
+	CollisionScenarioExperiment(const CollisionScenario &scenario, double impact2max, double energykeV)
+			: CollisionExperiment(scenario.name, getChannelNames(PeriodicTable::orbitalCount(scenario.element)),
+					0.28003, impact2max, energykeV, scenario.absoluteStepperError, scenario.relativeStepperError,
+					scenario.relativeEnergyError, PeriodicTable::massInAU(scenario.projectileMass)), scenario(
+					scenario) {
+
+		if (scenario.model == "AP")
+			target = new AbrinesPercivalAtom(&bbsystem, scenario.element, scenario.targetMass);
+		else
+			target = new KirschbaumWiletsAtom(&bbsystem, scenario.element, scenario.targetMass);
+		targetName = scenario.model + "-" + string(PeriodicTable::symbol(scenario.element));
+
+		// Kirschbaum-Wilets electrons captured by the projectile are held by a core as in p+He.
+		double charge = scenario.projectileCharge;
+		bool heisenberg = scenario.model == "KW" && charge > 0.0;
+
+		ForceTopology topology;
+		target->addForces(topology);
+		for (identifier electron : target->getElectrons()) {
+			bbsystem.addInteraction(new CoulombInteraction(-charge, projectile, electron));
+			topology.addCoulomb(-charge, projectile, electron);
+
+			if (heisenberg) {
+				bbsystem.addInteraction(new HeisenbergInteraction(KirschbaumWiletsAtom::heisenbergAlpha, 1.0,
+						projectile, electron));
+				topology.addHeisenberg(KirschbaumWiletsAtom::heisenbergAlpha, 1.0, projectile, electron);
+			}
+		}
+		bbsystem.addInteraction(new CoulombInteraction(charge * target->getNucleusCharge(), projectile,
+				target->getNucleus()));
+		topology.addCoulomb(charge * target->getNucleusCharge(), projectile, target->getNucleus());
+
+		binding = new BindingClassifier(&bbsystem, topology, target->getElectrons(),
+				{ target->getNucleus(), projectile });
+	}
+
+	Experiment* spawn() const {
+		return adopt(new CollisionScenarioExperiment(scenario, b2max, projectileEnergy));
+	}
+
+	size_t getLanes() const override {
+		return 1;
+	}
+
+	int open(int numberOfRounds, bool seedRandom) override {
+		if (scenario.model == "KW" && !GroundStateTable::getShared().contains(scenario.element)) {
+			cout << "No Kirschbaum-Wilets ground state of " << PeriodicTable::symbol(scenario.element)
+					<< " for scenario " << scenario.name << ", load a ground-state cache." << endl;
+			return 1;
+		}
+
+		return CollisionExperiment::open(numberOfRounds, seedRandom);
+	}
+
+	void setUp(int round, double impactParameter) override {
+		prepareTarget(target, round);
+		target->setPosition(vector3D(0, 0, 0));
+		target->setVelocity(vector3D(0, 0, 0));
+
+		bbsystem.setBodyPosition(projectile, vector3D(0, impactParameter, -initialDistance));
+		bbsystem.setBodyVelocity(projectile, vector3D(0, 0, projectileVelocity));
+	}
+
+	int run(int round, bool tracking, bool skipUntracked) {
+		runge_kutta_dopri5<Phase> stepper;
+		auto ctrdStepper = make_controlled(getAbsoluteStepperError(), getRelativeStepperError(), stepper);
+		Simulator<decltype(ctrdStepper)> simulator(ctrdStepper, &bbsystem);
+
+		double b = drawImpactParameter();
+		setUp(round, b);
+
+		DistanceCondition condition(projectile, target->getNucleus(), initialDistance + 1.0);
+
+		if (skipUntracked && !tracking) {
+			return 0;
+		}
+
+		startRecord(round, b);
+
+		if (tracking) {
+			printer = new Printer(to_string(round) + ".csv");
+			printer->addField(&printField);
+			simulator.setObserver(*printer);
+		}
+
+		if (condition.evaluate(bbsystem.phase, 0)) {
+			return store(-3, 0.0, 0.0);
+		}
+
+		double energy = getConservedEnergy();
+		double time = simulator.simulate(0.0, 1.0, 0.0001, recorded(condition), getMaxIntervals());
+
+		size_t electrons = target->getElectrons().size();
+		size_t ionized = 0, captured = 0;
+
+		while (true) {
+
+			sample(time);
+
+			if (time < 0.0) {
+				return store(-1, time, energy);
+			}
+
+			if (isEnergyOff(energy)) {
+				return store(-2, time, energy);
+			}
+
+			BindingMatrix bindings = binding->classify(bbsystem.phase);
+			bool predicted = resolve(*binding, bindings);
+
+			bool resolved = true;
+			ionized = captured = 0;
+			for (size_t electron = 0; electron < electrons; electron++) {
+				bool boundToTarget = bindings.isBound(electron, 0);
+				bool boundToProjec = bindings.isBound(electron, 1);
+				resolved = resolved && !(boundToTarget && boundToProjec);
+				if (!boundToTarget && !boundToProjec)
+					ionized++;
+				if (!boundToTarget && boundToProjec)
+					captured++;
+			}
+
+			if (resolved) {
+				if (predicted)
+					tally.predicted++;
+				break;
+			}
+
+			simulator.simulate(time, time + 1.0, 0.0001);
+			time += 1.0;
+			tally.extended++;
+			record.extensions++;
+		}
+
+		int32_t outcome = RoundRecord::noReaction;
+		if (ionized + captured > 0)
+			outcome = count(getChannel(ionized, captured));
+
+		return store(outcome, time, energy);
+	}
+
+private:
+
+	// Intervals of unit time the projectile gets to pass the atom.
+	int getMaxIntervals() const {
+		return (int) (1.2 * (2.0 * initialDistance + 1.0) / projectileVelocity + 1.0);
+	}
+
+	// Channels by the number of electrons lost, then by the number of them captured: with one electron
+	// ionization and capture, with two then double ionization, ionization & capture and double capture.
+	static size_t getChannel(size_t ionized, size_t captured) {
+		size_t lost = ionized + captured;
+		return lost * (lost + 1) / 2 - 1 + captured;
+	}
+
+	static vector<string> getChannelNames(size_t electrons) {
+		static const string multiplicities[] = { "", "Single", "Double", "Triple" };
+		auto name = [](size_t count, const string &process) {
+			return (count < size(multiplicities) ? multiplicities[count] : to_string(count) + "-fold") + " "
+					+ process;
+		};
+
+		vector<string> names;
+		for (size_t lost = 1; lost <= electrons; lost++) {
+			for (size_t captured = 0; captured <= lost; captured++) {
+				size_t ionized = lost - captured;
+				if (captured == 0)
+					names.push_back(name(ionized, "ionization"));
+				else if (ionized == 0)
+					names.push_back(name(captured, "el.capture"));
+				else
+					names.push_back(name(ionized, "ionization") + " & " + name(captured, "el.capture"));
+			}
+		}
+		return names;
+	}
+};
+
+#endif /* COLLISION_SCENARIO_HPP */
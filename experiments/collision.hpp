@@ -0,0 +1,515 @@
+#ifndef COLLISION_HPP
+#define COLLISION_HPP
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <boost/numeric/odeint.hpp>
+#include <simulbody/simulator.hpp>
+#include <simulbody/printer.hpp>
+
+#include "../atom.hpp"
+#include "../binding.hpp"
+#include "../experiment.hpp"
+#include "../flight-recorder.hpp"
+#include "../lockstep.hpp"
+#include "../multirate.hpp"
+#include "../record.hpp"
+
+using namespace std;
+
+// Counts the right-hand side evaluations of the integrator, exerts no force.
+class EvaluationCounter: public Interaction {
+public:
+	uint64_t evaluations = 0;
+
+	EvaluationCounter(identifier body) {
+		this->setBodies(body, body);
+	}
+
+	virtual void apply(const Phase &x, Phase &dxdt, const double t) override {
+		evaluations++;
+	}
+
+	virtual double getEnergy(const Phase &phase) override {
+		return 0.0;
+	}
+};
+
+// Keeps a body at its velocity by dropping the forces on it, and the velocity terms of the Heisenberg
+// cores, for a projectile on a prescribed straight line. It has to come after the interactions acting on
+// the body.
+class PrescribedMotion: public Interaction {
+	size_t position;
+	size_t velocity;
+
+public:
+	PrescribedMotion(System* system, identifier body)
+			: position(getPhaseOffset(system, body, false)), velocity(getPhaseOffset(system, body, true)) {
+		this->setBodies(body, body);
+	}
+
+	virtual void apply(const Phase &x, Phase &dxdt, const double t) override {
+		for (size_t k = 0; k < 3; k++) {
+			dxdt[position + k] = x[velocity + k];
+			dxdt[velocity + k] = 0.0;
+		}
+	}
+
+	virtual double getEnergy(const Phase &phase) override {
+		return 0.0;
+	}
+};
+
+// State of a round integrated in a lane of the lockstep simulator, waiting for run().
+struct LaneResult {
+	int round;
+	Phase phase;
+	double time;
+	uint64_t evaluations;
+};
+
+// Common part of the ion-atom collision experiments: the projectile, the stepper tolerances
+// and the outcome channels counted in the tally.
+class CollisionExperiment: public Experiment {
+
+protected:
+
+	RecordWriter* records;
+	RoundRecord record;
+	uint64_t retriedEvaluations = 0;	// of the failed attempts of the round
+
+	System bbsystem;
+	System fastSystem;			// the same bodies with the target interactions only, for multirate runs
+	Atom* fastTarget;
+	Printer* printer;
+	PositionPrintField printField;
+
+	FlightRecorder* recorder;
+	RecordingCondition recordingCondition;
+	vector<int32_t> flightFilter;
+
+	identifier projectile;
+	PrescribedMotion* projectilePath;	// with a straight-line projectile
+	const Atom* roundTarget;			// the target prepared for the round
+	EvaluationCounter* counter;
+	EvaluationCounter* fastCounter;
+
+	vector<LaneResult> laneResults;
+
+	vector<string> channels;
+	double crossSectionUnit;
+	string targetName;
+
+	double b2max;
+	double projectileEnergy;
+	double projectileVelocity;
+	double absoluteStepperError;
+	double relativeStepperError;
+	double relativeEnergyError;
+
+public:
+
+	CollisionExperiment(string name, vector<string> channels, double crossSectionUnit, double impact2max,
+			double energykeV, double absoluteStepperError, double relativeStepperError,
+			double relativeEnergyError, double projectileMass = Atom::protonMass)
+			: recordingCondition(nullptr, nullptr), channels(channels), crossSectionUnit(crossSectionUnit), b2max(
+					impact2max), projectileEnergy(energykeV), absoluteStepperError(absoluteStepperError),
+					relativeStepperError(relativeStepperError), relativeEnergyError(relativeEnergyError) {
+
+		projectileVelocity = Utils::calculateAcceleratedVelocityInAU(projectileMass, 1.0, energykeV);
+		projectile = bbsystem.createBody(projectileMass);
+		fastSystem.createBody(projectileMass);
+		fastTarget = nullptr;
+		printer = nullptr;
+		recorder = nullptr;
+		records = nullptr;
+		projectilePath = nullptr;
+		roundTarget = nullptr;
+
+		counter = new EvaluationCounter(projectile);
+		bbsystem.addInteraction(counter);
+
+		fastCounter = new EvaluationCounter(projectile);
+		fastSystem.addInteraction(fastCounter);
+
+		tally.experiment = name;
+		tally.b2max = b2max;
+		tally.energy = energykeV;
+		tally.outcomes.assign(channels.size(), 0);
+	}
+
+	// One AVX-512 register of doubles, two of AVX2.
+	static constexpr size_t lockstepLanes = 8;
+
+	// Workers write their records through the result store of the experiment that spawned them.
+	Experiment* adopt(CollisionExperiment* experiment) const {
+		experiment->records = records;
+		return experiment;
+	}
+
+	int open(int numberOfRounds, bool seedRandom) override {
+		if (ensemble != nullptr && ensemble->getTarget() != targetName) {
+			cout << "The ensemble holds " << ensemble->getTarget() << " targets, not " << targetName << "." << endl;
+			return 1;
+		}
+
+		if (!flightOutcomes.empty() && recorder == nullptr) {
+			if (!findFlightOutcomes())
+				return 1;
+			recorder = new FlightRecorder(flightSamples, flightInterval);
+		}
+
+		// Added after all the other interactions of the projectile.
+		if (straightLine && projectilePath == nullptr) {
+			projectilePath = new PrescribedMotion(&bbsystem, projectile);
+			bbsystem.addInteraction(projectilePath);
+			prescribeProjectile();
+		}
+
+		if (worker != 0)
+			return 0;
+
+		if (ensemble != nullptr && (size_t) numberOfRounds > ensemble->size())
+			cout << "The ensemble holds " << ensemble->size() << " states only, they will be reused." << endl;
+
+		if (approachRadius > 0.0 && approachRadius * approachRadius < b2max)
+			cout << "Rounds with impact parameters beyond the approach radius are integrated in full." << endl;
+
+		// The KS and lockstep integrators run without the stop condition that samples the flight.
+		if (recorder != nullptr && (regularizing || getLanes() > 1))
+			cout << "Flight recordings of KS-regularized and lockstep rounds are sampled only once the projectile "
+					"has passed the target." << endl;
+
+		RecordHeader header;
+		header.experiment = tally.experiment;
+		header.b2max = b2max;
+		header.energy = projectileEnergy;
+		header.seed = seed;
+		header.phaseLength = bbsystem.phase.size();
+		header.channels = channels;
+
+		records = new RecordWriter();
+		// Records are numbered from 1, so those of the rounds before the cursor go up to it.
+		try {
+			records->open(labeledFileName("result.bbr"), header, resuming, tally.cursor, flushSeconds);
+		} catch (const exception &e) {
+			cout << e.what() << endl;
+			delete records;
+			records = nullptr;
+			return 1;
+		}
+		return 0;
+	}
+
+	int close(int successfulRounds) override {
+		report(tally);
+
+		int result = 0;
+		if (worker == 0 && records != nullptr) {
+			try {
+				records->close();
+			} catch (const exception &e) {
+				cout << e.what() << endl;
+				result = 1;
+			}
+			delete records;
+			records = nullptr;
+		}
+
+		return result;
+	}
+
+	size_t getLanes() const override {
+		return lockstep && multirateFactor <= 0.0 ? lockstepLanes : 1;
+	}
+
+	void flushResults() override {
+		if (records != nullptr)
+			records->flush();
+	}
+
+	// Resolves the outcomes the flight recorder writes out: codes, channel names or 'failed' (-1 to -3).
+	bool findFlightOutcomes() {
+		flightFilter.clear();
+
+		for (const string &name : flightOutcomes) {
+			auto channel = find(channels.begin(), channels.end(), name);
+			if (channel != channels.end()) {
+				flightFilter.push_back(channel - channels.begin() + 1);
+			} else if (name == "failed") {
+				flightFilter.insert(flightFilter.end(), { -1, -2, -3 });
+			} else {
+				istringstream code(name);
+				int32_t outcome;
+				if (!(code >> outcome) || !code.eof() || outcome < -3 || outcome > (int32_t) channels.size()) {
+					cout << "Unknown outcome for the flight recorder: " << name << endl;
+					return false;
+				}
+				flightFilter.push_back(outcome);
+			}
+		}
+
+		return true;
+	}
+
+	// The stop condition of the round, sampling the phase into the flight recorder if there is one.
+	Condition& recorded(Condition &condition) {
+		if (recorder == nullptr)
+			return condition;
+
+		recordingCondition = RecordingCondition(&condition, recorder);
+		return recordingCondition;
+	}
+
+	// Samples the phase into the flight recorder if there is one.
+	void sample(double time) {
+		if (recorder != nullptr)
+			(*recorder)(bbsystem.phase, time);
+	}
+
+	// Stepper tolerances of the current attempt of the round.
+	double getAbsoluteStepperError() const {
+		return absoluteStepperError * toleranceScale * pow(retryFactor, retryTier);
+	}
+
+	double getRelativeStepperError() const {
+		return relativeStepperError * toleranceScale * pow(retryFactor, retryTier);
+	}
+
+	// Places the target and the projectile for a round with the given impact parameter.
+	virtual void setUp(int round, double impactParameter) = 0;
+
+	// Drops the forces on the projectile in the force kernels of the experiment, for a straight-line projectile.
+	virtual void prescribeProjectile() {
+	}
+
+	// Energy the integration conserves. A straight-line projectile does work on the target, but the forces
+	// depend on the distances only, so the work is balanced by the momentum P the target takes up: with the
+	// projectile velocity u fixed, E - u·P is conserved.
+	double getConservedEnergy() const {
+		double energy = bbsystem.getSystemEnergy();
+		if (straightLine && roundTarget != nullptr)
+			energy -= bbsystem.getBodyVelocity(projectile).scalarProduct(roundTarget->getImpulse());
+		return energy;
+	}
+
+	// Whether the conserved energy is off by more than allowed.
+	bool isEnergyOff(double energy) const {
+		return abs((energy - getConservedEnergy()) / energy) > relativeEnergyError;
+	}
+
+	// Advances the bodies analytically to where the integration of the round starts and returns that time.
+	virtual double approach(double impactParameter) {
+		return 0.0;
+	}
+
+	// Sets the rounds up as run() does and integrates them in the lanes until the projectile is farther
+	// than distance from the nucleus. Rounds that start there already are left to run().
+	template<class Lockstep>
+	void integrateLanes(Lockstep* lockstep, const vector<int> &rounds, const vector<int> &strata,
+			identifier nucleus, double distance, double interval, int maxIntervals) {
+		laneResults.clear();
+		lockstep->setTolerances(getAbsoluteStepperError(), getRelativeStepperError());
+
+		for (size_t i = 0; i < rounds.size(); i++) {
+			randomEngine.seed(seed, rounds[i]);
+			stratum = strata[i];
+
+			double b = drawImpactParameter();
+			setUp(rounds[i], b);
+
+			vector3D r = bbsystem.getBodyPosition(projectile) - bbsystem.getBodyPosition(nucleus);
+			if (sqrt(r.scalarProduct(r)) > distance)
+				continue;
+
+			lockstep->load(laneResults.size(), approach(b));
+			laneResults.push_back( { rounds[i], Phase(), 0.0, 0 });
+		}
+
+		lockstep->simulate(laneResults.size(), interval, 0.0001, projectile, nucleus, distance, maxIntervals);
+
+		for (size_t lane = 0; lane < laneResults.size(); lane++) {
+			lockstep->store(lane);
+			laneResults[lane].phase = bbsystem.phase;
+			laneResults[lane].time = lockstep->getTime(lane);
+			laneResults[lane].evaluations = lockstep->getEvaluations(lane);
+		}
+	}
+
+	// Takes up the state of the round if it was integrated in a lane, with the time it got to.
+	bool takeLane(int round, double &time) {
+		for (auto lane = laneResults.begin(); lane != laneResults.end(); lane++) {
+			if (lane->round != round)
+				continue;
+
+			bbsystem.phase = lane->phase;
+			time = lane->time;
+			counter->evaluations += lane->evaluations;
+			laneResults.erase(lane);
+			return true;
+		}
+
+		return false;
+	}
+
+	// Draws the impact parameter uniformly in b² over the stratum of the round, or over [0, b2max].
+	double drawImpactParameter() {
+		double width = tally.strata > 0 ? b2max / tally.strata : b2max;
+		uniform_real_distribution<double> distributionB2(stratum * width, (stratum + 1) * width);
+		return sqrt(distributionB2(randomEngine));
+	}
+
+	// Samples the initial state of the target, or takes it from the ensemble if there is one. The target is
+	// kept as the one of the round, for its momentum.
+	void prepareTarget(Atom* target, int round) {
+		roundTarget = target;
+		if (ensemble != nullptr)
+			target->setState(ensemble->draw(seed, round));
+		else
+			target->randomize(randomEngine);
+	}
+
+	// Time until the projectile, starting initialDistance before the target, comes within the approach
+	// radius. The target is neutral, so the asymptotic Coulomb path of the projectile is a straight line.
+	// Zero if the round has no approach phase.
+	double getApproachTime(double impactParameter, double initialDistance) const {
+		if (approachRadius <= 0.0 || impactParameter >= approachRadius)
+			return 0.0;
+
+		double distance = sqrt(approachRadius * approachRadius - impactParameter * impactParameter);
+		return max(0.0, (initialDistance - distance) / projectileVelocity);
+	}
+
+	// Energy error allowed in one outer step of the multirate integration.
+	double getMultirateEnergyTolerance() const {
+		return 0.01 * relativeEnergyError;
+	}
+
+	// Starts the record of a round from the initial conditions in the system.
+	void startRecord(int round, double impactParameter) {
+		record.round = round;
+		record.impactParameter = impactParameter;
+		record.initialPhase.assign(bbsystem.phase.begin(), bbsystem.phase.end());
+		record.extensions = 0;
+		record.tier = retryTier;
+		counter->evaluations = 0;
+		fastCounter->evaluations = 0;
+		if (retryTier == 0)
+			retriedEvaluations = 0;
+
+		if (recorder != nullptr) {
+			recorder->reset(bbsystem.phase.size());
+			sample(0.0);
+		}
+	}
+
+	// Counts a reaction and returns its outcome code.
+	int32_t count(int channel) {
+		tally.outcomes[channel]++;
+		return channel + 1;
+	}
+
+	// With outcome prediction, decides the electrons bound to several centers from their two-body orbits.
+	bool resolve(const BindingClassifier &classifier, BindingMatrix &bindings) const {
+		return predictionMargin > 0.0 && classifier.resolve(bbsystem.phase, bindings, predictionMargin);
+	}
+
+	// Completes the record of the round, writes it to the result store and returns the result of run().
+	// Failed attempts which will be retried are not written; the evaluations of the round include theirs.
+	int store(int32_t outcome, double time, double initialEnergy) {
+		if ((outcome == -1 || outcome == -2) && retryTier < retryTiers) {
+			retriedEvaluations += counter->evaluations;
+			if (printer != nullptr) {
+				delete printer;
+				printer = nullptr;
+			}
+			return outcome;
+		}
+
+		record.outcome = outcome;
+		record.endTime = time;
+		record.energyError = 0.0;
+		if (initialEnergy != 0.0)
+			record.energyError = (getConservedEnergy() - initialEnergy) / initialEnergy;
+		record.evaluations = counter->evaluations + retriedEvaluations;
+
+		records->write(record);
+
+		if (recorder != nullptr && find(flightFilter.begin(), flightFilter.end(), outcome) != flightFilter.end())
+			recorder->write(labeledFileName("flight-" + to_string(record.round) + ".bbf"), record);
+
+		if (printer != nullptr) {
+			delete printer;
+			printer = nullptr;
+		}
+
+		return outcome < 0 ? outcome : 0;
+	}
+
+	~CollisionExperiment() {
+		delete recorder;
+	}
+
+	// Cross sections of the channels with their standard errors, weighted over the strata if stratified.
+	vector<CrossSection> getCrossSections(const Tally &tally) const override {
+		vector<CrossSection> crossSections;
+		double area = M_PI * tally.b2max * crossSectionUnit;
+
+		for (size_t c = 0; c < channels.size(); c++) {
+			double error = 0.0, low = 0.0, high = 0.0;
+			double rate = tally.estimate(c, error);
+			tally.interval(c, 1.96, low, high);
+			crossSections.push_back( { channels[c], rate * area, error * area, low * area, high * area });
+		}
+
+		return crossSections;
+	}
+
+	void report(const Tally &tally) const override {
+		size_t width = 0;
+		for (const string &channel : channels) {
+			width = max(width, channel.size());
+		}
+
+		double successfulRounds = (double) tally.successful;
+		for (size_t c = 0; c < channels.size(); c++) {
+			double error = 0.0;
+			double rate = tally.estimate(c, error);
+			cout << left << setw(width) << channels[c] << right << ": " << tally.outcomes[c] << " ("
+					<< rate * 100.0 << " %)" << endl;
+		}
+
+		double extendedRate = ((double) tally.extended) / successfulRounds;
+		cout << "Extended run: " << tally.extended << " (" << extendedRate * 100.0 << " %)" << endl;
+		if (tally.retried > 0) {
+			double retriedRate = ((double) tally.retried) / (successfulRounds + tally.failed);
+			cout << "Retried: " << tally.retried << " (" << retriedRate * 100.0 << " %)" << endl;
+		}
+		if (tally.predicted > 0) {
+			double predictedRate = ((double) tally.predicted) / successfulRounds;
+			cout << "Predicted: " << tally.predicted << " (" << predictedRate * 100.0 << " %)" << endl;
+		}
+		cout << endl;
+
+		if (tally.strata > 0) {
+			cout << "Rounds in the b² strata:";
+			for (long rounds : tally.stratumRounds) {
+				cout << " " << rounds;
+			}
+			cout << endl << endl;
+		}
+
+		cout << "Cross sections:" << endl;
+
+		for (const CrossSection &crossSection : getCrossSections(tally)) {
+			cout << "\t " << left << setw(width) << crossSection.channel << right << ": " << crossSection.value
+					<< " +- " << crossSection.error << " (95 % CI " << crossSection.low << " - " << crossSection.high
+					<< ")" << endl;
+		}
+		cout << endl;
+	}
+};
+
+#endif /* COLLISION_HPP */
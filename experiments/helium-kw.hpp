@@ -49,8 +49,8 @@ public:
 		cout << "Number of bodies: " << helium->getBodies().size() << endl;
 		cout << "Number of inters: " << helium->getInteractions().size() << endl;
 		cout << "Orbits: " << endl;
-		for (string orbit : helium->getOrbitNames()) {
-			cout << orbit << " (ion. en.: " << helium->getIonizationEnergy(orbit) << ")" << endl;
+		for (string_view orbit : helium->getOrbitNames()) {
+			cout << orbit << " (ion. en.: " << helium->getIonizationEnergy(string(orbit)) << ")" << endl;
 		}
 		cout << endl;
 
@@ -17,8 +17,8 @@ class SandboxExperiment: public Experiment {
 		simulbody::System bbsystem;
 		AbrinesPercivalAtom hydrogen(&bbsystem, Element::H, 1.00782503207);
 
-		std::mt19937_64 randomEngine;
-		randomEngine.seed(std::mt19937_64::default_seed);
+		RandomEngine randomEngine;
+		randomEngine.seed(RandomEngine::default_seed);
 
 		cout.precision(10);
 		cout << hydrogen.getNucleus() << endl;
@@ -0,0 +1,91 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "flight-recorder.hpp"
+
+using namespace std;
+
+static const char flightFileMagic[8] = { 'B', 'B', 'F', 'L', 'I', 'G', 'H', '1' };
+static const size_t headerFieldsSize = 40;
+
+FlightRecorder::FlightRecorder(size_t capacity, double interval)
+		: capacity(max((size_t) 1, capacity)), interval(interval) {
+}
+
+void FlightRecorder::reset(size_t phaseLength) {
+	if (this->phaseLength != phaseLength) {
+		this->phaseLength = phaseLength;
+		samples.assign(capacity * (1 + phaseLength), 0.0);
+	}
+
+	next = 0;
+	count = 0;
+}
+
+void FlightRecorder::operator()(const Phase &phase, double time) {
+	if (count > 0 && time < lastTime + interval)
+		return;
+
+	double* sample = samples.data() + next * (1 + phaseLength);
+	sample[0] = time;
+	copy(phase.begin(), phase.begin() + phaseLength, sample + 1);
+
+	next = (next + 1) % capacity;
+	count = min(count + 1, capacity);
+	lastTime = time;
+}
+
+size_t FlightRecorder::size() const {
+	return count;
+}
+
+void FlightRecorder::write(const string &fileName, const RoundRecord &record) const {
+	char header[headerFieldsSize] = { };
+	uint32_t sizes[2] = { (uint32_t) phaseLength, (uint32_t) count };
+	memcpy(header, flightFileMagic, 8);
+	memcpy(header + 8, sizes, sizeof(sizes));
+	memcpy(header + 16, &record.round, 8);
+	memcpy(header + 24, &record.impactParameter, 8);
+	memcpy(header + 32, &record.outcome, 4);
+
+	ofstream out(fileName, ios::binary | ios::trunc);
+	out.write(header, headerFieldsSize);
+
+	// The oldest sample is the next to be overwritten once the ring is full.
+	size_t sampleSize = (1 + phaseLength) * sizeof(double);
+	size_t first = count < capacity ? 0 : next;
+	for (size_t i = 0; i < count; i++) {
+		const double* sample = samples.data() + ((first + i) % capacity) * (1 + phaseLength);
+		out.write(reinterpret_cast<const char*>(sample), sampleSize);
+	}
+
+	if (!out)
+		throw runtime_error("Failed to write flight recording " + fileName + ".");
+}
+
+// static
+FlightHeader FlightRecorder::read(const string &fileName, vector<double> &samples) {
+	ifstream in(fileName, ios::binary);
+	char header[headerFieldsSize];
+	in.read(header, headerFieldsSize);
+	if (!in || memcmp(header, flightFileMagic, 8) != 0)
+		throw runtime_error(fileName + " is not a flight recording.");
+
+	FlightHeader flight;
+	uint32_t sizes[2];
+	memcpy(sizes, header + 8, sizeof(sizes));
+	memcpy(&flight.round, header + 16, 8);
+	memcpy(&flight.impactParameter, header + 24, 8);
+	memcpy(&flight.outcome, header + 32, 4);
+	flight.phaseLength = sizes[0];
+	flight.samples = sizes[1];
+
+	samples.resize((size_t) flight.samples * (1 + flight.phaseLength));
+	in.read(reinterpret_cast<char*>(samples.data()), samples.size() * sizeof(double));
+	if (!in)
+		throw runtime_error(fileName + " is cut short.");
+
+	return flight;
+}
@@ -0,0 +1,75 @@
+#ifndef FLIGHT_RECORDER_HPP
+#define FLIGHT_RECORDER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <simulbody/simulator.hpp>
+
+#include "record.hpp"
+
+using namespace simulbody;
+
+// Round described at the beginning of a flight recording.
+struct FlightHeader {
+	uint64_t round = 0;
+	double impactParameter = 0.0;
+	int32_t outcome = RoundRecord::noReaction;
+	uint32_t phaseLength = 0;
+	uint32_t samples = 0;
+};
+
+// In-memory recording of the trajectory of the current round: the last samples of the time and the phase,
+// at least the sampling interval apart, in a ring buffer allocated once. It is written out only for the
+// rounds whose outcome is asked for, so rounds that end well cost a copy of the phase now and then.
+//
+// A recording file is the header followed by the samples, oldest first, each the time and the phase.
+class FlightRecorder {
+
+	std::size_t capacity;
+	double interval;
+
+	std::size_t phaseLength = 0;
+	std::size_t next = 0;
+	std::size_t count = 0;
+	double lastTime = 0.0;
+	std::vector<double> samples;
+
+public:
+
+	FlightRecorder(std::size_t capacity, double interval);
+
+	// Clears the recording for a new round.
+	void reset(std::size_t phaseLength);
+
+	// Samples the phase unless the last sample is less than the interval before.
+	void operator()(const Phase &phase, double time);
+
+	std::size_t size() const;
+
+	void write(const std::string &fileName, const RoundRecord &record) const;
+
+	static FlightHeader read(const std::string &fileName, std::vector<double> &samples);
+};
+
+// Stop condition which samples the phase into a flight recorder whenever it is evaluated, that is, at the
+// end of every integration interval whichever simulator runs the round.
+class RecordingCondition: public Condition {
+
+	Condition* condition;
+	FlightRecorder* recorder;
+
+public:
+
+	RecordingCondition(Condition* condition, FlightRecorder* recorder)
+			: condition(condition), recorder(recorder) {
+	}
+
+	virtual bool evaluate(const Phase &phase, double time) override {
+		(*recorder)(phase, time);
+		return condition->evaluate(phase, time);
+	}
+};
+
+#endif /* FLIGHT_RECORDER_HPP */
@@ -0,0 +1,56 @@
+#include <algorithm>
+
+#include "fused-forces.hpp"
+
+using namespace simulbody;
+
+void ForceTopology::addCoulomb(double charge, identifier earth, identifier moon) {
+	getPair(earth, moon).charge += charge;
+}
+
+// The Coulomb term does not depend on the orientation of the pair, the Heisenberg core does:
+// the pair is turned so that the electron is its moon.
+void ForceTopology::addHeisenberg(double alpha, double xi, identifier nucleus, identifier electron) {
+	PairForces &pair = getPair(nucleus, electron);
+	if (pair.heisenberg)
+		throw std::logic_error("The pair has a Heisenberg core already.");
+
+	pair.earth = nucleus;
+	pair.moon = electron;
+	pair.heisenberg = true;
+	pair.alpha = alpha;
+	pair.xi = xi;
+}
+
+PairForces& ForceTopology::getPair(identifier earth, identifier moon) {
+	for (PairForces &pair : pairs) {
+		if ((pair.earth == earth && pair.moon == moon) || (pair.earth == moon && pair.moon == earth))
+			return pair;
+	}
+
+	PairForces pair;
+	pair.earth = earth;
+	pair.moon = moon;
+	pairs.push_back(pair);
+	return pairs.back();
+}
+
+std::size_t getPhaseOffset(System* system, identifier body, bool velocity) {
+	Phase saved = system->phase;
+	std::fill(system->phase.begin(), system->phase.end(), 0.0);
+
+	if (velocity)
+		system->setBodyVelocity(body, vector3D(1.0, 0.0, 0.0));
+	else
+		system->setBodyPosition(body, vector3D(1.0, 0.0, 0.0));
+
+	auto offset = std::find(system->phase.begin(), system->phase.end(), 1.0);
+	bool found = offset != system->phase.end();
+	std::size_t index = offset - system->phase.begin();
+	system->phase = saved;
+
+	if (!found)
+		throw std::logic_error("The body is not found in the phase.");
+
+	return index;
+}
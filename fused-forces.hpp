@@ -0,0 +1,217 @@
+#ifndef FUSED_FORCES_HPP
+#define FUSED_FORCES_HPP
+
+#include <array>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+#include <boost/numeric/odeint.hpp>
+#include <simulbody/simulator.hpp>
+
+using namespace simulbody;
+
+// Forces between one pair of bodies: a Coulomb term (charge / r as in CoulombInteraction) and optionally
+// a Heisenberg core (as in HeisenbergInteraction, the moon being the electron).
+struct PairForces {
+	identifier earth;
+	identifier moon;
+	double charge = 0.0;
+	bool heisenberg = false;
+	double alpha = 0.0;
+	double xi = 0.0;
+};
+
+// The fixed set of interactions of an experiment, gathered by pairs of bodies.
+class ForceTopology {
+
+public:
+	std::vector<PairForces> pairs;
+
+	void addCoulomb(double charge, identifier earth, identifier moon);
+	void addHeisenberg(double alpha, double xi, identifier nucleus, identifier electron);
+
+private:
+	PairForces& getPair(identifier earth, identifier moon);
+};
+
+// Offset of the position (or the velocity) of a body in the phase of the system. It is looked up through
+// the system, not assumed; the phase is left as it was.
+std::size_t getPhaseOffset(System* system, identifier body, bool velocity);
+
+// Right-hand side of the equations of motion of a system with a fixed topology, compiled for its number
+// of bodies. It takes the place of the list of virtual Interaction::apply() calls: every pair of bodies
+// is visited once, its relative position and velocity are shared by its Coulomb and Heisenberg terms,
+// and the intermediates stay in local variables. Experiments without Heisenberg cores leave them out
+// at compile time.
+template<std::size_t Bodies, bool Heisenberg>
+class FusedForces {
+
+	static constexpr std::size_t Pairs = Bodies * (Bodies - 1) / 2;
+
+	struct Pair {
+		std::size_t earth, moon;			// offsets of the positions in the phase
+		std::size_t earthVelocity, moonVelocity;
+		double charge = 0.0;
+		double inverseEarthMass = 0.0, inverseMoonMass = 0.0;
+
+		bool heisenberg = false;
+		double alpha = 0.0;
+		double reducedMass = 0.0;
+		double xi4 = 0.0;
+		double muSlashXi2 = 0.0;
+		double xi2DotMu = 0.0;
+		double xi2SlashAlphaSlashMuSlash2 = 0.0;
+	};
+
+	std::array<std::size_t, Bodies> positions;
+	std::array<std::size_t, Bodies> velocities;
+	std::array<Pair, Pairs> pairs;
+	std::size_t pairCount = 0;
+	uint64_t* evaluations;
+
+public:
+
+	// The evaluations are counted like those of the interactions the kernel replaces.
+	FusedForces(System* system, const ForceTopology &topology, uint64_t* evaluations)
+			: evaluations(evaluations) {
+
+		if (system->phase.size() != 6 * Bodies)
+			throw std::invalid_argument("The system does not have the bodies the force kernel is compiled for.");
+		if (topology.pairs.size() > Pairs)
+			throw std::invalid_argument("The topology has more pairs than the bodies can form.");
+
+		for (identifier body = 0; body < Bodies; body++) {
+			positions[body] = getPhaseOffset(system, body, false);
+			velocities[body] = getPhaseOffset(system, body, true);
+		}
+
+		for (const PairForces &forces : topology.pairs) {
+			if (forces.heisenberg && !Heisenberg)
+				throw std::invalid_argument("The force kernel is compiled without Heisenberg cores.");
+
+			Pair &pair = pairs[pairCount++];
+
+			double earthMass = system->getBodyMass(forces.earth);
+			double moonMass = system->getBodyMass(forces.moon);
+
+			pair.earth = positions[forces.earth];
+			pair.moon = positions[forces.moon];
+			pair.earthVelocity = velocities[forces.earth];
+			pair.moonVelocity = velocities[forces.moon];
+			pair.charge = forces.charge;
+			pair.inverseEarthMass = 1.0 / earthMass;
+			pair.inverseMoonMass = 1.0 / moonMass;
+
+			if (forces.heisenberg) {
+				double xi2 = forces.xi * forces.xi;
+				pair.heisenberg = true;
+				pair.alpha = forces.alpha;
+				pair.reducedMass = earthMass * moonMass / (earthMass + moonMass);
+				pair.xi4 = xi2 * xi2;
+				pair.muSlashXi2 = pair.reducedMass / xi2;
+				pair.xi2DotMu = xi2 * pair.reducedMass;
+				pair.xi2SlashAlphaSlashMuSlash2 = xi2 / pair.alpha / pair.reducedMass / 2;
+			}
+		}
+	}
+
+	// Drops the forces on the body and the velocity terms of its Heisenberg cores, so that it keeps its
+	// velocity: a projectile on a prescribed straight line.
+	void prescribe(identifier body) {
+		for (std::size_t i = 0; i < pairCount; i++) {
+			Pair &pair = pairs[i];
+			if (pair.earth == positions[body])
+				pair.inverseEarthMass = 0.0;
+			if (pair.moon == positions[body])
+				pair.inverseMoonMass = 0.0;
+		}
+	}
+
+	void operator()(const Phase &x, Phase &dxdt, const double t) const {
+		(*evaluations)++;
+
+		for (std::size_t body = 0; body < Bodies; body++) {
+			for (std::size_t k = 0; k < 3; k++) {
+				dxdt[positions[body] + k] = x[velocities[body] + k];
+				dxdt[velocities[body] + k] = 0.0;
+			}
+		}
+
+		for (std::size_t i = 0; i < pairCount; i++) {
+			const Pair &pair = pairs[i];
+			double r[3];
+			for (std::size_t k = 0; k < 3; k++)
+				r[k] = x[pair.moon + k] - x[pair.earth + k];
+
+			double r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+			double forceFactor = pair.charge / (r2 * sqrt(r2));
+
+			if constexpr (Heisenberg) {
+				if (pair.heisenberg) {
+					double v[3];
+					for (std::size_t k = 0; k < 3; k++)
+						v[k] = x[pair.moonVelocity + k] - x[pair.earthVelocity + k];
+
+					double r4 = r2 * r2;
+					double p2 = (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]) * pair.reducedMass * pair.reducedMass;
+					double p4 = p2 * p2;
+					double exponent = exp(pair.alpha * (1 - r4 * p4 / pair.xi4));
+
+					forceFactor += pair.xi2SlashAlphaSlashMuSlash2 * exponent / r4 + p4 * exponent / pair.xi2DotMu;
+
+					// As in HeisenbergInteraction the moon is taken to be an electron of unit mass.
+					double velocityFactor = -p2 * pair.muSlashXi2 * r2 * exponent;
+					for (std::size_t k = 0; k < 3; k++) {
+						dxdt[pair.moon + k] += v[k] * velocityFactor;
+						dxdt[pair.earth + k] -= v[k] * velocityFactor * pair.inverseEarthMass;
+					}
+				}
+			}
+
+			for (std::size_t k = 0; k < 3; k++) {
+				double force = r[k] * forceFactor;
+				dxdt[pair.moonVelocity + k] += force * pair.inverseMoonMass;
+				dxdt[pair.earthVelocity + k] -= force * pair.inverseEarthMass;
+			}
+		}
+	}
+};
+
+// Integrates the phase of a system with a fused force kernel, with the interface of Simulator.
+template<class Stepper, class Forces>
+class FusedSimulator {
+
+	Stepper stepper;
+	Forces forces;
+	System* system;
+
+public:
+
+	FusedSimulator(Stepper stepper, const Forces &forces, System* system)
+			: stepper(stepper), forces(forces), system(system) {
+	}
+
+	double simulate(double startTime, double endTime, double dt) {
+		boost::numeric::odeint::integrate_adaptive(stepper, std::cref(forces), system->phase, startTime,
+				endTime, dt);
+		return endTime;
+	}
+
+	// Runs in intervals of endTime - startTime until the condition holds, as Simulator does.
+	template<class Condition>
+	double simulate(double startTime, double endTime, double dt, Condition &condition, int maxRounds) {
+		double interval = endTime - startTime;
+		double time = startTime;
+
+		for (int round = 0; round < maxRounds; round++) {
+			time = simulate(time, time + interval, dt);
+			if (condition.evaluate(system->phase, time))
+				return time;
+		}
+
+		return -1.0;
+	}
+};
+
+#endif /* FUSED_FORCES_HPP */
@@ -0,0 +1,399 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#include "ground-states.hpp"
+#include "cohen.hpp"
+#include "kirschbaum-wilets.hpp"
+#include "random.hpp"
+
+using namespace std;
+
+static const char groundStateFileMagic[8] = { 'B', 'B', 'K', 'W', 'G', 'S', 'T', '1' };
+static const size_t headerFieldsSize = 32;
+
+// Energy of a Kirschbaum-Wilets atom with the nucleus at rest in the origin and its gradient, as a
+// function of the positions and the velocities of the electrons (6 values each). The interactions are
+// those of KirschbaumWiletsAtom::createInteractions().
+struct AtomEnergy {
+	size_t electrons;
+	double charge;
+	double reducedMass;
+	double alpha;
+	double xi2, xi4;
+
+	double operator()(const vector<double> &x, vector<double> &gradient) const {
+		double energy = 0.0;
+		fill(gradient.begin(), gradient.end(), 0.0);
+
+		double mu2 = reducedMass * reducedMass;
+		double heisenbergFactor = xi2 / (4 * alpha * reducedMass);
+
+		for (size_t i = 0; i < electrons; i++) {
+			const double* r = &x[6 * i];
+			const double* v = &x[6 * i + 3];
+			double* gr = &gradient[6 * i];
+			double* gv = &gradient[6 * i + 3];
+
+			double r2 = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+			double v2 = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+			double rNorm = sqrt(r2);
+			double p2 = v2 * mu2;
+			double p4 = p2 * p2;
+			double exponent = exp(alpha * (1 - r2 * r2 * p4 / xi4));
+			double heisenberg = heisenbergFactor * exponent;
+
+			energy += v2 / 2 - charge / rNorm + heisenberg / r2;
+
+			// The radial derivative of the Heisenberg core divided by r, and its momentum derivative by v.
+			double positionFactor = charge / (r2 * rNorm) + heisenberg * (-2 / (r2 * r2) - 4 * alpha * p4 / xi4);
+			double velocityFactor = 1.0 - 4 * alpha * heisenberg * r2 * mu2 * p2 / xi4;
+			for (size_t k = 0; k < 3; k++) {
+				gr[k] += r[k] * positionFactor;
+				gv[k] += v[k] * velocityFactor;
+			}
+
+			for (size_t j = 0; j < i; j++) {
+				const double* s = &x[6 * j];
+				double d[3] = { r[0] - s[0], r[1] - s[1], r[2] - s[2] };
+				double inverse = 1 / sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+				double inverse3 = inverse * inverse * inverse;
+
+				energy += inverse;
+				for (size_t k = 0; k < 3; k++) {
+					gr[k] -= d[k] * inverse3;
+					gradient[6 * j + k] += d[k] * inverse3;
+				}
+			}
+		}
+
+		return energy;
+	}
+};
+
+static double dot(const vector<double> &a, const vector<double> &b) {
+	double sum = 0.0;
+	for (size_t i = 0; i < a.size(); i++) {
+		sum += a[i] * b[i];
+	}
+	return sum;
+}
+
+// Limited-memory BFGS with a backtracking line search. The Heisenberg core makes the energy very stiff
+// near its minimum, steps into the core are rejected by the line search (overflows compare false).
+static double minimize(const AtomEnergy &atomEnergy, vector<double> &x) {
+	const size_t memory = 8;
+	const int maxIterations = 20000;
+	const double tolerance = 1e-10;
+
+	size_t n = x.size();
+	vector<double> gradient(n), trial(n), trialGradient(n), direction(n);
+	vector<vector<double>> s, y;
+	vector<double> rho, a(memory);
+
+	double energy = atomEnergy(x, gradient);
+
+	for (int iteration = 0; iteration < maxIterations; iteration++) {
+		double largest = 0.0;
+		for (double g : gradient) {
+			largest = max(largest, fabs(g));
+		}
+		if (largest < tolerance)
+			break;
+
+		// Two-loop recursion for the quasi-Newton direction.
+		direction = gradient;
+		for (size_t k = s.size(); k-- > 0;) {
+			a[k] = rho[k] * dot(s[k], direction);
+			for (size_t i = 0; i < n; i++) {
+				direction[i] -= a[k] * y[k][i];
+			}
+		}
+
+		double gamma = s.empty() ? min(1.0, 0.1 / largest) : dot(s.back(), y.back()) / dot(y.back(), y.back());
+		for (size_t i = 0; i < n; i++) {
+			direction[i] *= -gamma;
+		}
+
+		for (size_t k = 0; k < s.size(); k++) {
+			double b = rho[k] * dot(y[k], direction);
+			for (size_t i = 0; i < n; i++) {
+				direction[i] -= s[k][i] * (a[k] + b);
+			}
+		}
+
+		double slope = dot(gradient, direction);
+		if (!(slope < 0.0)) {
+			s.clear();
+			y.clear();
+			rho.clear();
+			for (size_t i = 0; i < n; i++) {
+				direction[i] = -gradient[i] * min(1.0, 0.1 / largest);
+			}
+			slope = dot(gradient, direction);
+		}
+
+		double step = 1.0;
+		double trialEnergy = 0.0;
+		bool accepted = false;
+		for (int tries = 0; tries < 60 && !accepted; tries++) {
+			for (size_t i = 0; i < n; i++) {
+				trial[i] = x[i] + step * direction[i];
+			}
+			trialEnergy = atomEnergy(trial, trialGradient);
+			accepted = trialEnergy <= energy + 1e-4 * step * slope;
+			step /= 2;
+		}
+
+		if (!accepted)
+			break;
+
+		vector<double> ds(n), dy(n);
+		for (size_t i = 0; i < n; i++) {
+			ds[i] = trial[i] - x[i];
+			dy[i] = trialGradient[i] - gradient[i];
+		}
+
+		double curvature = dot(ds, dy);
+		if (curvature > 1e-300) {
+			if (s.size() == memory) {
+				s.erase(s.begin());
+				y.erase(y.begin());
+				rho.erase(rho.begin());
+			}
+			s.push_back(ds);
+			y.push_back(dy);
+			rho.push_back(1.0 / curvature);
+		}
+
+		x.swap(trial);
+		gradient.swap(trialGradient);
+		energy = trialEnergy;
+	}
+
+	return energy;
+}
+
+GroundStateTable::GroundStateTable(double alpha, double xi)
+		: alpha(alpha), xi(xi) {
+	offsets.fill(absent);
+}
+
+double GroundStateTable::getAlpha() const {
+	return alpha;
+}
+
+double GroundStateTable::getXi() const {
+	return xi;
+}
+
+bool GroundStateTable::contains(Element element) const {
+	int z = PeriodicTable::atomicNumber(element);
+	return z >= 1 && z <= PeriodicTable::maxAtomicNumber && offsets[z] != absent;
+}
+
+double GroundStateTable::getEnergy(Element element) const {
+	return energies.at(PeriodicTable::atomicNumber(element));
+}
+
+const double* GroundStateTable::getOrbit(Element element, size_t orbit) const {
+	return values.data() + offsets[PeriodicTable::atomicNumber(element)] + 6 * orbit;
+}
+
+void GroundStateTable::set(Element element, const vector<double> &configuration, double energy) {
+	int z = PeriodicTable::atomicNumber(element);
+	if (configuration.size() != 6 * PeriodicTable::orbitalCount(element))
+		throw invalid_argument("The configuration does not have the orbits of the element.");
+
+	if (contains(element)) {
+		copy(configuration.begin(), configuration.end(), values.begin() + offsets[z]);
+	} else {
+		offsets[z] = values.size();
+		values.insert(values.end(), configuration.begin(), configuration.end());
+	}
+	energies[z] = energy;
+}
+
+void GroundStateTable::load(const string &fileName) {
+	ifstream in(fileName, ios::binary);
+	if (!in)
+		throw runtime_error("Failed to open ground-state cache " + fileName + ".");
+
+	char header[headerFieldsSize];
+	uint32_t count = 0;
+	double fileAlpha = 0.0, fileXi = 0.0;
+	in.read(header, headerFieldsSize);
+	memcpy(&count, header + 8, 4);
+	memcpy(&fileAlpha, header + 16, 8);
+	memcpy(&fileXi, header + 24, 8);
+
+	if (!in || memcmp(header, groundStateFileMagic, 8) != 0)
+		throw runtime_error(fileName + " is not a ground-state cache.");
+	if (fileAlpha != alpha || fileXi != xi)
+		throw runtime_error(fileName + " was optimized for another Heisenberg core.");
+
+	for (uint32_t i = 0; i < count; i++) {
+		uint32_t sizes[2];
+		double energy;
+		in.read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+		in.read(reinterpret_cast<char*>(&energy), 8);
+		if (!in || sizes[0] < 1 || sizes[0] > (uint32_t) PeriodicTable::maxAtomicNumber)
+			throw runtime_error(fileName + " is not a ground-state cache.");
+
+		vector<double> configuration(6 * sizes[1]);
+		in.read(reinterpret_cast<char*>(configuration.data()), configuration.size() * sizeof(double));
+		if (!in)
+			throw runtime_error(fileName + " is cut short.");
+
+		set(static_cast<Element>(sizes[0]), configuration, energy);
+	}
+}
+
+void GroundStateTable::save(const string &fileName) const {
+	vector<int> elements;
+	for (int z = 1; z <= PeriodicTable::maxAtomicNumber; z++) {
+		if (contains(static_cast<Element>(z)))
+			elements.push_back(z);
+	}
+
+	char header[headerFieldsSize] = { };
+	uint32_t count = elements.size();
+	memcpy(header, groundStateFileMagic, 8);
+	memcpy(header + 8, &count, 4);
+	memcpy(header + 16, &alpha, 8);
+	memcpy(header + 24, &xi, 8);
+
+	ofstream out(fileName, ios::binary | ios::trunc);
+	out.write(header, headerFieldsSize);
+
+	for (int z : elements) {
+		Element element = static_cast<Element>(z);
+		uint32_t sizes[2] = { (uint32_t) z, (uint32_t) PeriodicTable::orbitalCount(element) };
+		out.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+		out.write(reinterpret_cast<const char*>(&energies[z]), 8);
+		out.write(reinterpret_cast<const char*>(getOrbit(element, 0)), 6 * sizes[1] * sizeof(double));
+	}
+
+	if (!out)
+		throw runtime_error("Failed to write ground-state cache " + fileName + ".");
+}
+
+// static
+GroundStateTable& GroundStateTable::getShared() {
+	static GroundStateTable table = [] {
+		GroundStateTable cohen(KirschbaumWiletsAtom::heisenbergAlpha, KirschbaumWiletsAtom::heisenbergXi);
+		for (int z = 1; z <= CohenConfiguration::maxAtomicNumber; z++) {
+			Element element = static_cast<Element>(z);
+			vector<double> configuration;
+			for (size_t orbit = 0; orbit < PeriodicTable::orbitalCount(element); orbit++) {
+				vector3D position = CohenConfiguration::position(element, orbit);
+				vector3D momentum = CohenConfiguration::momentum(element, orbit);
+				for (const vector3D &value : { position, momentum }) {
+					configuration.push_back(value.scalarProduct(vector3D(1, 0, 0)));
+					configuration.push_back(value.scalarProduct(vector3D(0, 1, 0)));
+					configuration.push_back(value.scalarProduct(vector3D(0, 0, 1)));
+				}
+			}
+			cohen.set(element, configuration, NAN);
+		}
+		return cohen;
+	}();
+	return table;
+}
+
+// static
+vector<double> GroundStateTable::optimize(Element element, double nucleusMass, double alpha, double xi, int starts,
+		uint64_t seed, int threads, double &energy) {
+	AtomEnergy atomEnergy;
+	atomEnergy.electrons = PeriodicTable::orbitalCount(element);
+	atomEnergy.charge = PeriodicTable::atomicNumber(element);
+	atomEnergy.reducedMass = Atom::electronMass * nucleusMass / (Atom::electronMass + nucleusMass);
+	atomEnergy.alpha = alpha;
+	atomEnergy.xi2 = xi * xi;
+	atomEnergy.xi4 = atomEnergy.xi2 * atomEnergy.xi2;
+
+	// The lowest minimum wins, the first start of equal ones, so the result does not depend on the threads.
+	vector<double> best;
+	int bestStart = -1;
+	energy = INFINITY;
+	mutex bestMutex;
+	atomic<int> nextStart(0);
+
+	auto work = [&]() {
+		uniform_real_distribution<double> distMinusOneOne(-1, 1);
+		uniform_real_distribution<double> distMinusPiPi(-M_PI, M_PI);
+		uniform_real_distribution<double> distLogRadius(log(0.05), log(3.0));
+
+		int start;
+		while ((start = nextStart.fetch_add(1)) < starts) {
+			RandomEngine randomEngine(seed, ((uint64_t) atomEnergy.charge << 32) | (uint64_t) start);
+
+			// Electrons in random directions, outside of their Heisenberg cores: r p a bit above xi.
+			vector<double> x(6 * atomEnergy.electrons);
+			for (size_t i = 0; i < atomEnergy.electrons; i++) {
+				double r = exp(distLogRadius(randomEngine));
+				double v = 1.2 * xi / (atomEnergy.reducedMass * r);
+				for (size_t part = 0; part < 2; part++) {
+					double cosTheta = distMinusOneOne(randomEngine);
+					double sinTheta = sqrt(1 - cosTheta * cosTheta);
+					double phi = distMinusPiPi(randomEngine);
+					double length = part == 0 ? r : v;
+					x[6 * i + 3 * part] = length * sinTheta * cos(phi);
+					x[6 * i + 3 * part + 1] = length * sinTheta * sin(phi);
+					x[6 * i + 3 * part + 2] = length * cosTheta;
+				}
+			}
+
+			double minimum = minimize(atomEnergy, x);
+
+			lock_guard<mutex> lock(bestMutex);
+			if (minimum < energy || (minimum == energy && start < bestStart)) {
+				energy = minimum;
+				bestStart = start;
+				best = x;
+			}
+		}
+	};
+
+	vector<thread> pool;
+	for (int w = 1; w < threads; w++) {
+		pool.push_back(thread(work));
+	}
+
+	work();
+
+	for (thread &t : pool) {
+		t.join();
+	}
+
+	if (best.empty())
+		throw runtime_error("No ground state found.");
+
+	return best;
+}
+
+// static
+void GroundStateTable::generate(const string &fileName, int starts, uint64_t seed, int threads) {
+	GroundStateTable table(KirschbaumWiletsAtom::heisenbergAlpha, KirschbaumWiletsAtom::heisenbergXi);
+
+	for (int z = static_cast<int>(Element::Li); z <= static_cast<int>(Element::Ar); z++) {
+		Element element = static_cast<Element>(z);
+		double nucleusMass = PeriodicTable::nucleusMassInAU(element, PeriodicTable::isotopeMass(element));
+
+		double energy;
+		vector<double> configuration = optimize(element, nucleusMass, table.alpha, table.xi, starts, seed,
+				threads, energy);
+		table.set(element, configuration, energy);
+
+		cout << "Z = " << z << ": " << energy << " au" << endl;
+	}
+
+	table.save(fileName);
+}
@@ -0,0 +1,61 @@
+#ifndef GROUND_STATES_HPP
+#define GROUND_STATES_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "elements.hpp"
+
+// Ground-state configurations of Kirschbaum-Wilets atoms for one alpha and xi of the Heisenberg core:
+// the position and the velocity of every electron relative to the nucleus at rest, 6 values per orbit in
+// the order of the orbits of the atom. The configurations of all elements are kept in one flat array
+// indexed by the atomic number and the orbit.
+//
+// H and He come from the Cohen configuration. Heavier elements are found by minimizing the energy of the
+// atom and written to a binary cache, which runs load at startup.
+class GroundStateTable {
+
+	double alpha = 0.0;
+	double xi = 0.0;
+
+	std::array<std::size_t, PeriodicTable::maxAtomicNumber + 1> offsets;		// first value, absent if none
+	std::array<double, PeriodicTable::maxAtomicNumber + 1> energies { };
+	std::vector<double> values;
+
+public:
+
+	static constexpr std::size_t absent = SIZE_MAX;
+
+	GroundStateTable(double alpha, double xi);
+
+	double getAlpha() const;
+	double getXi() const;
+
+	bool contains(Element element) const;
+	double getEnergy(Element element) const;
+
+	// Position (3 values), then velocity (3 values) of the electron of the orbit.
+	const double* getOrbit(Element element, std::size_t orbit) const;
+
+	void set(Element element, const std::vector<double> &configuration, double energy);
+
+	// Adds the configurations of a cache file; its alpha and xi have to be those of the table.
+	void load(const std::string &fileName);
+	void save(const std::string &fileName) const;
+
+	// The table of the Kirschbaum-Wilets atoms: the Cohen configurations and the loaded cache. The cache
+	// is loaded before the workers start and is read-only afterwards.
+	static GroundStateTable& getShared();
+
+	// Lowest energy configuration from a number of random starting points, shared by the threads.
+	static std::vector<double> optimize(Element element, double nucleusMass, double alpha, double xi, int starts,
+			uint64_t seed, int threads, double &energy);
+
+	// Optimizes Li to Ar for the alpha and xi of the Kirschbaum-Wilets atom into a cache file.
+	static void generate(const std::string &fileName, int starts, uint64_t seed, int threads);
+};
+
+#endif /* GROUND_STATES_HPP */
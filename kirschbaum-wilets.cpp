@@ -1,6 +1,10 @@
 #include <cmath>
+#include <stdexcept>
+#include <string>
 
 #include "kirschbaum-wilets.hpp"
+#include "fused-forces.hpp"
+#include "ground-states.hpp"
 #include <simulbody/interactions/coulomb.hpp>
 
 
@@ -76,18 +80,23 @@ KirschbaumWiletsAtom::KirschbaumWiletsAtom(System* system, Element electronConfi
 
 void KirschbaumWiletsAtom::install() {
 
-	CohenConfiguration configuration;
+	const GroundStateTable &groundStates = GroundStateTable::getShared();
+	if (!groundStates.contains(electronConfiguration))
+		throw std::invalid_argument("No Kirschbaum-Wilets ground state of Z = "
+				+ std::to_string(PeriodicTable::atomicNumber(electronConfiguration)) + ", load a ground-state cache.");
 
 	system->setBodyPosition(nucleus, vector3D(0.0, 0.0, 0.0));
 	system->setBodyVelocity(nucleus, vector3D(0.0, 0.0, 0.0));
 
-	for (string orbit : orbitNames) {
-		system->setBodyPosition(getElectron(orbit), configuration.position(electronConfiguration, orbit));
-		system->setBodyVelocity(getElectron(orbit), configuration.momentum(electronConfiguration, orbit));
+	for (size_t orbit = 0; orbit < orbitNames.size(); orbit++) {
+		const double* state = groundStates.getOrbit(electronConfiguration, orbit);
+		identifier electron = getElectron(orbit);
+		system->setBodyPosition(electron, vector3D(state[0], state[1], state[2]));
+		system->setBodyVelocity(electron, vector3D(state[3], state[4], state[5]));
 	}
 }
 
-void KirschbaumWiletsAtom::randomize(std::mt19937_64 &randomEngine) {
+void KirschbaumWiletsAtom::randomize(RandomEngine &randomEngine) {
 	std::uniform_real_distribution<double> distMinusPiPi(-M_PI, M_PI);
 	std::uniform_real_distribution<double> distMinusOneOne(-1, 1);
 
@@ -112,10 +121,21 @@ void KirschbaumWiletsAtom::createInteractions() {
 				interactions.push_back(new CoulombInteraction(1.0, e1, e2));
 		}
 		interactions.push_back(new CoulombInteraction(-1.0 * nucleusCharge, nucleus, e1));
-		interactions.push_back(new HeisenbergInteraction(45.0, 1.257, nucleus, e1));
+		interactions.push_back(new HeisenbergInteraction(heisenbergAlpha, heisenbergXi, nucleus, e1));
 	}
 
 	for (Interaction* interaction : interactions) {
 		system->addInteraction(interaction);
 	}
 }
+
+void KirschbaumWiletsAtom::addForces(ForceTopology &topology) const {
+	for (identifier e1 : getElectrons()) {
+		for (identifier e2 : getElectrons()) {
+			if (e1 < e2)
+				topology.addCoulomb(1.0, e1, e2);
+		}
+		topology.addCoulomb(-1.0 * nucleusCharge, nucleus, e1);
+		topology.addHeisenberg(heisenbergAlpha, heisenbergXi, nucleus, e1);
+	}
+}
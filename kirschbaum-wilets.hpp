@@ -5,7 +5,6 @@
 #include <simulbody/simulator.hpp>
 
 #include "atom.hpp"
-#include "cohen.hpp"
 
 using namespace simulbody;
 
@@ -42,8 +41,12 @@ public:
 	KirschbaumWiletsAtom(System* system, Element electronConfig, Element nucleusElement, double atomicMass);
 
 	virtual void install() override;
-	virtual void randomize(std::mt19937_64 &randomEngine) override;
+	virtual void randomize(RandomEngine &randomEngine) override;
 	virtual void createInteractions() override;
+	virtual void addForces(ForceTopology &topology) const override;
+
+	static constexpr double heisenbergAlpha = 45.0;
+	static constexpr double heisenbergXi = 1.257;
 };
 
 #endif /* KIRSCHBAUM_WILETS_HPP */
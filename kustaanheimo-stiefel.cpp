@@ -0,0 +1,217 @@
+#include <cmath>
+#include <boost/numeric/odeint.hpp>
+
+#include "kustaanheimo-stiefel.hpp"
+
+using namespace simulbody;
+using namespace boost::numeric::odeint;
+using namespace std;
+
+// Layout of the state: KS coordinates u and their derivatives w = du/ds, Kepler energy h of the pair,
+// physical time t, relative position R and velocity dR/dt of the perturber.
+enum {
+	U = 0, W = 4, H = 8, T = 9, R = 10, RV = 13, StateSize = 16
+};
+
+static void components(const vector3D &v, double* c) {
+	static const vector3D axes[3] = { vector3D(1, 0, 0), vector3D(0, 1, 0), vector3D(0, 0, 1) };
+	for (int i = 0; i < 3; i++) {
+		c[i] = v.scalarProduct(axes[i]);
+	}
+}
+
+// The first three rows of the KS matrix L(u) applied to a, and its transpose applied to (b, 0).
+static void applyL(const double* u, const double* a, double* x) {
+	x[0] = u[0] * a[0] - u[1] * a[1] - u[2] * a[2] + u[3] * a[3];
+	x[1] = u[1] * a[0] + u[0] * a[1] - u[3] * a[2] - u[2] * a[3];
+	x[2] = u[2] * a[0] + u[3] * a[1] + u[0] * a[2] + u[1] * a[3];
+}
+
+static void applyLTransposed(const double* u, const double* b, double* q) {
+	q[0] = u[0] * b[0] + u[1] * b[1] + u[2] * b[2];
+	q[1] = -u[1] * b[0] + u[0] * b[1] + u[3] * b[2];
+	q[2] = -u[2] * b[0] - u[3] * b[1] + u[0] * b[2];
+	q[3] = u[3] * b[0] - u[2] * b[1] + u[1] * b[2];
+}
+
+KustaanheimoStiefelSimulator::KustaanheimoStiefelSimulator(System* system, identifier nucleus,
+		identifier electron, identifier perturber, double pairCharge, double nucleusPerturberCharge,
+		double electronPerturberCharge, double absoluteStepperError, double relativeStepperError)
+		: system(system), nucleus(nucleus), electron(electron), perturber(perturber), nucleusPerturberCharge(
+				nucleusPerturberCharge), electronPerturberCharge(electronPerturberCharge), absoluteStepperError(
+				absoluteStepperError), relativeStepperError(relativeStepperError), centerTime(0.0), y(StateSize) {
+
+	double nucleusMass = system->getBodyMass(nucleus);
+	double electronMass = system->getBodyMass(electron);
+	double perturberMass = system->getBodyMass(perturber);
+	double pairMass = nucleusMass + electronMass;
+	double totalMass = pairMass + perturberMass;
+
+	nucleusShare = electronMass / pairMass;
+	electronShare = nucleusMass / pairMass;
+	pairShare = perturberMass / totalMass;
+	perturberShare = pairMass / totalMass;
+	pairReducedMass = nucleusMass * electronMass / pairMass;
+	perturberReducedMass = perturberMass * pairMass / totalMass;
+
+	k = -pairCharge / pairReducedMass;
+}
+
+void KustaanheimoStiefelSimulator::setTolerances(double absoluteStepperError, double relativeStepperError) {
+	this->absoluteStepperError = absoluteStepperError;
+	this->relativeStepperError = relativeStepperError;
+}
+
+double KustaanheimoStiefelSimulator::simulate(double time, double endTime, double distance) {
+	load(time);
+
+	auto stepper = make_controlled(absoluteStepperError, relativeStepperError, runge_kutta_dopri5<State>());
+	auto equations = [this](const State &y, State &dydt, double s) {
+		(*this)(y, dydt, s);
+	};
+
+	double s = 0.0;
+	double ds = 1e-4;
+	size_t steps = 0;
+
+	while (distance <= 0.0 || getPerturberDistance() <= distance) {
+		if (y[T] >= endTime) {
+			store();
+			return distance > 0.0 ? -1.0 : y[T];
+		}
+
+		if (++steps > maxSteps) {
+			store();
+			return -1.0;
+		}
+
+		stepper.try_step(equations, y, s, ds);
+	}
+
+	store();
+	return y[T];
+}
+
+void KustaanheimoStiefelSimulator::operator()(const State &y, State &dydt, double s) {
+	evaluations++;
+
+	const double* u = &y[U];
+	const double* w = &y[W];
+	double r = u[0] * u[0] + u[1] * u[1] + u[2] * u[2] + u[3] * u[3];
+
+	double x[3];
+	applyL(u, u, x);
+
+	// Perturbing accelerations of the relative coordinate x of the pair and of the perturber.
+	double perturbation[3], acceleration[3];
+	double dn[3], de[3];
+	for (int i = 0; i < 3; i++) {
+		dn[i] = y[R + i] + nucleusShare * x[i];
+		de[i] = y[R + i] - electronShare * x[i];
+	}
+
+	double dn2 = dn[0] * dn[0] + dn[1] * dn[1] + dn[2] * dn[2];
+	double de2 = de[0] * de[0] + de[1] * de[1] + de[2] * de[2];
+	double fn = nucleusPerturberCharge / (dn2 * sqrt(dn2));
+	double fe = electronPerturberCharge / (de2 * sqrt(de2));
+
+	for (int i = 0; i < 3; i++) {
+		perturbation[i] = (fn * nucleusShare * dn[i] - fe * electronShare * de[i]) / pairReducedMass;
+		acceleration[i] = (fn * dn[i] + fe * de[i]) / perturberReducedMass;
+	}
+
+	double q[4];
+	applyLTransposed(u, perturbation, q);
+
+	double hDot = 0.0;
+	for (int i = 0; i < 4; i++) {
+		dydt[U + i] = w[i];
+		dydt[W + i] = 0.5 * y[H] * u[i] + 0.5 * r * q[i];
+		hDot += 2.0 * w[i] * q[i];
+	}
+
+	dydt[H] = hDot;
+	dydt[T] = r;
+
+	for (int i = 0; i < 3; i++) {
+		dydt[R + i] = r * y[RV + i];
+		dydt[RV + i] = r * acceleration[i];
+	}
+}
+
+void KustaanheimoStiefelSimulator::load(double time) {
+	vector<identifier> bodies = { nucleus, electron, perturber };
+	center = system->getGroupCenterOfMass(bodies);
+	centerVelocity = system->getGroupImpulse(bodies) / system->getGroupMass(bodies);
+	centerTime = time;
+
+	vector3D pairCenter = system->getBodyPosition(nucleus) * electronShare
+			+ system->getBodyPosition(electron) * nucleusShare;
+	vector3D pairVelocity = system->getBodyVelocity(nucleus) * electronShare
+			+ system->getBodyVelocity(electron) * nucleusShare;
+
+	double x[3], v[3];
+	components(system->getBodyPosition(electron) - system->getBodyPosition(nucleus), x);
+	components(system->getBodyVelocity(electron) - system->getBodyVelocity(nucleus), v);
+	components(system->getBodyPosition(perturber) - pairCenter, &y[R]);
+	components(system->getBodyVelocity(perturber) - pairVelocity, &y[RV]);
+
+	// Of the KS coordinates with L(u) u = x the one is taken that avoids dividing by a small component.
+	double r = sqrt(x[0] * x[0] + x[1] * x[1] + x[2] * x[2]);
+	double* u = &y[U];
+	if (x[0] >= 0.0) {
+		u[0] = sqrt(0.5 * (r + x[0]));
+		u[1] = x[1] / (2.0 * u[0]);
+		u[2] = x[2] / (2.0 * u[0]);
+		u[3] = 0.0;
+	} else {
+		u[1] = sqrt(0.5 * (r - x[0]));
+		u[0] = x[1] / (2.0 * u[1]);
+		u[2] = 0.0;
+		u[3] = x[2] / (2.0 * u[1]);
+	}
+
+	double w[4];
+	applyLTransposed(u, v, w);
+	for (int i = 0; i < 4; i++) {
+		y[W + i] = 0.5 * w[i];
+	}
+
+	y[H] = 0.5 * (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]) - k / r;
+	y[T] = time;
+}
+
+void KustaanheimoStiefelSimulator::store() const {
+	const double* u = &y[U];
+	double r = u[0] * u[0] + u[1] * u[1] + u[2] * u[2] + u[3] * u[3];
+
+	double x[3], v[3];
+	applyL(u, u, x);
+	applyL(u, &y[W], v);
+
+	vector3D relativePosition(x[0], x[1], x[2]);
+	vector3D relativeVelocity(2.0 * v[0] / r, 2.0 * v[1] / r, 2.0 * v[2] / r);
+	vector3D perturberPosition(y[R], y[R + 1], y[R + 2]);
+	vector3D perturberVelocity(y[RV], y[RV + 1], y[RV + 2]);
+
+	vector3D position = center + centerVelocity * (y[T] - centerTime);
+	vector3D pairCenter = position - perturberPosition * pairShare;
+	vector3D pairVelocity = centerVelocity - perturberVelocity * pairShare;
+
+	system->setBodyPosition(nucleus, pairCenter - relativePosition * nucleusShare);
+	system->setBodyVelocity(nucleus, pairVelocity - relativeVelocity * nucleusShare);
+	system->setBodyPosition(electron, pairCenter + relativePosition * electronShare);
+	system->setBodyVelocity(electron, pairVelocity + relativeVelocity * electronShare);
+	system->setBodyPosition(perturber, position + perturberPosition * perturberShare);
+	system->setBodyVelocity(perturber, centerVelocity + perturberVelocity * perturberShare);
+}
+
+double KustaanheimoStiefelSimulator::getPerturberDistance() const {
+	double x[3], d[3];
+	applyL(&y[U], &y[U], x);
+	for (int i = 0; i < 3; i++) {
+		d[i] = y[R + i] + nucleusShare * x[i];
+	}
+
+	return sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+}
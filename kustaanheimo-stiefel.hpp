@@ -0,0 +1,67 @@
+#ifndef KUSTAANHEIMO_STIEFEL_HPP
+#define KUSTAANHEIMO_STIEFEL_HPP
+
+#include <vector>
+#include <simulbody/simulator.hpp>
+
+using namespace simulbody;
+
+// Integrates a Coulomb-bound electron-nucleus pair perturbed by a third charged body (the projectile)
+// in Kustaanheimo-Stiefel coordinates. With the fictitious time s (dt = r ds) the Kepler motion of the
+// pair becomes a harmonic oscillator, so passing close to the nucleus costs no more steps than the rest
+// of the orbit. The projectile moves in Jacobi coordinates relative to the center of mass of the pair.
+class KustaanheimoStiefelSimulator {
+
+public:
+	typedef std::vector<double> State;
+
+	uint64_t evaluations = 0;
+
+	// Charges are the products of the charges of the pairs, as in CoulombInteraction.
+	KustaanheimoStiefelSimulator(System* system, identifier nucleus, identifier electron, identifier perturber,
+			double pairCharge, double nucleusPerturberCharge, double electronPerturberCharge,
+			double absoluteStepperError, double relativeStepperError);
+
+	// Integrates the bodies from the given time until the perturber is farther than distance from the
+	// nucleus (never if zero) or endTime is passed. Returns the time reached, which may overshoot endTime
+	// by a step, or -1 if endTime passed before the distance was reached.
+	double simulate(double time, double endTime, double distance = 0.0);
+
+	void setTolerances(double absoluteStepperError, double relativeStepperError);
+
+	void operator()(const State &y, State &dydt, double s);
+
+private:
+	System* system;
+	identifier nucleus;
+	identifier electron;
+	identifier perturber;
+
+	double k;					// pair charge over the reduced mass of the pair
+	double nucleusPerturberCharge;
+	double electronPerturberCharge;
+
+	double nucleusShare;		// mass fractions placing nucleus and electron about the pair center
+	double electronShare;
+	double pairShare;			// mass fractions placing pair center and perturber about the center of mass
+	double perturberShare;
+	double pairReducedMass;
+	double perturberReducedMass;
+
+	double absoluteStepperError;
+	double relativeStepperError;
+
+	vector3D center;
+	vector3D centerVelocity;
+	double centerTime;
+
+	State y;
+
+	void load(double time);
+	void store() const;
+	double getPerturberDistance() const;
+
+	static const std::size_t maxSteps = 10000000;
+};
+
+#endif /* KUSTAANHEIMO_STIEFEL_HPP */
@@ -0,0 +1,424 @@
+#ifndef LOCKSTEP_HPP
+#define LOCKSTEP_HPP
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <initializer_list>
+#include <utility>
+#include <stdexcept>
+#include <simulbody/simulator.hpp>
+
+#include "fused-forces.hpp"
+
+using namespace simulbody;
+
+// Integrates Lanes independent trajectories of the same system at once, in lockstep. The state is kept
+// in structure-of-arrays layout, one value of every lane next to each other, so the forces (those of a
+// ForceTopology, as in FusedForces) and the Dormand-Prince 5(4) stages run on the vector units across
+// the lanes. Every lane keeps its own step size, controlled as the odeint controlled stepper does, its
+// own clock and its own stop condition. Lanes that are done stand still until the last one is done.
+template<std::size_t Bodies, bool Heisenberg, std::size_t Lanes>
+class LockstepSimulator {
+
+	static constexpr std::size_t Pairs = Bodies * (Bodies - 1) / 2;
+	static constexpr std::size_t Dimension = 6 * Bodies;
+
+	typedef std::array<double, Lanes> Values;
+	typedef std::array<Values, Dimension> State;
+
+	// Body b has its position at 6 b and its velocity at 6 b + 3.
+	struct Pair {
+		std::size_t earth = 0, moon = 0;
+		double charge = 0.0;
+		double inverseEarthMass = 0.0, inverseMoonMass = 0.0;
+
+		bool heisenberg = false;
+		double alpha = 0.0;
+		double reducedMass = 0.0;
+		double xi4 = 0.0;
+		double muSlashXi2 = 0.0;
+		double xi2DotMu = 0.0;
+		double xi2SlashAlphaSlashMuSlash2 = 0.0;
+	};
+
+	System* system;
+	std::array<Pair, Pairs> pairs;
+	std::size_t pairCount = 0;
+
+	double absoluteStepperError;
+	double relativeStepperError;
+
+	alignas(64) State x, y, k1, k2, k3, k4, k5, k6, k7, error;
+	alignas(64) Values time, step, intervalEnd;
+	std::array<int, Lanes> intervals;
+	std::array<bool, Lanes> active;
+	std::array<uint64_t, Lanes> evaluations;
+
+public:
+
+	LockstepSimulator(System* system, const ForceTopology &topology, double absoluteStepperError,
+			double relativeStepperError)
+			: system(system), absoluteStepperError(absoluteStepperError), relativeStepperError(
+					relativeStepperError) {
+
+		if (system->phase.size() != Dimension)
+			throw std::invalid_argument("The system does not have the bodies the lockstep simulator is compiled for.");
+		if (topology.pairs.size() > Pairs)
+			throw std::invalid_argument("The topology has more pairs than the bodies can form.");
+
+		for (const PairForces &forces : topology.pairs) {
+			if (forces.heisenberg && !Heisenberg)
+				throw std::invalid_argument("The lockstep simulator is compiled without Heisenberg cores.");
+
+			Pair &pair = pairs[pairCount++];
+			double earthMass = system->getBodyMass(forces.earth);
+			double moonMass = system->getBodyMass(forces.moon);
+
+			pair.earth = 6 * forces.earth;
+			pair.moon = 6 * forces.moon;
+			pair.charge = forces.charge;
+			pair.inverseEarthMass = 1.0 / earthMass;
+			pair.inverseMoonMass = 1.0 / moonMass;
+
+			if (forces.heisenberg) {
+				double xi2 = forces.xi * forces.xi;
+				pair.heisenberg = true;
+				pair.alpha = forces.alpha;
+				pair.reducedMass = earthMass * moonMass / (earthMass + moonMass);
+				pair.xi4 = xi2 * xi2;
+				pair.muSlashXi2 = pair.reducedMass / xi2;
+				pair.xi2DotMu = xi2 * pair.reducedMass;
+				pair.xi2SlashAlphaSlashMuSlash2 = xi2 / pair.alpha / pair.reducedMass / 2;
+			}
+		}
+
+		active.fill(false);
+		time.fill(0.0);
+		evaluations.fill(0);
+	}
+
+	static constexpr std::size_t getLanes() {
+		return Lanes;
+	}
+
+	// Drops the forces on the body and the velocity terms of its Heisenberg cores, as FusedForces does.
+	void prescribe(identifier body) {
+		for (std::size_t i = 0; i < pairCount; i++) {
+			if (pairs[i].earth == 6 * body)
+				pairs[i].inverseEarthMass = 0.0;
+			if (pairs[i].moon == 6 * body)
+				pairs[i].inverseMoonMass = 0.0;
+		}
+	}
+
+	void setTolerances(double absoluteStepperError, double relativeStepperError) {
+		this->absoluteStepperError = absoluteStepperError;
+		this->relativeStepperError = relativeStepperError;
+	}
+
+	// Takes the state of the system into a lane, to be integrated from the given time.
+	void load(std::size_t lane, double startTime) {
+		for (identifier body = 0; body < Bodies; body++) {
+			vector3D position = system->getBodyPosition(body);
+			vector3D velocity = system->getBodyVelocity(body);
+			for (std::size_t k = 0; k < 3; k++) {
+				x[6 * body + k][lane] = position.scalarProduct(axis(k));
+				x[6 * body + 3 + k][lane] = velocity.scalarProduct(axis(k));
+			}
+		}
+
+		time[lane] = startTime;
+		evaluations[lane] = 0;
+	}
+
+	// Puts the state of a lane into the system.
+	void store(std::size_t lane) const {
+		for (identifier body = 0; body < Bodies; body++) {
+			system->setBodyPosition(body, vector3D(x[6 * body][lane], x[6 * body + 1][lane], x[6 * body + 2][lane]));
+			system->setBodyVelocity(body,
+					vector3D(x[6 * body + 3][lane], x[6 * body + 4][lane], x[6 * body + 5][lane]));
+		}
+	}
+
+	// Time the lane got to, or -1 if its condition did not hold within the intervals.
+	double getTime(std::size_t lane) const {
+		return time[lane];
+	}
+
+	uint64_t getEvaluations(std::size_t lane) const {
+		return evaluations[lane];
+	}
+
+	// Integrates the first count lanes, as Simulator does, in intervals of the given length until
+	// the bodies a and b are farther apart than distance, at most maxIntervals of them.
+	void simulate(std::size_t count, double interval, double dt, identifier a, identifier b, double distance,
+			int maxIntervals) {
+
+		// Unused lanes repeat the first one, so all lanes hold finite states.
+		for (std::size_t lane = count; lane < Lanes; lane++) {
+			for (std::size_t i = 0; i < Dimension; i++)
+				x[i][lane] = x[i][0];
+		}
+
+		for (std::size_t lane = 0; lane < Lanes; lane++) {
+			active[lane] = lane < count;
+			step[lane] = active[lane] ? std::min(dt, interval) : 0.0;
+			intervalEnd[lane] = time[lane] + interval;
+			intervals[lane] = 0;
+		}
+
+		evaluate(x, k1);
+
+		while (std::any_of(active.begin(), active.end(), [](bool a) {
+			return a;
+		})) {
+			tryStep();
+
+			for (std::size_t lane = 0; lane < Lanes; lane++) {
+				if (!active[lane])
+					continue;
+
+				double taken = step[lane];
+				if (!adjustStep(lane))
+					continue;
+
+				for (std::size_t i = 0; i < Dimension; i++) {
+					x[i][lane] = y[i][lane];
+					k1[i][lane] = k7[i][lane];
+				}
+
+				time[lane] += taken;
+				if (time[lane] >= intervalEnd[lane]) {
+					time[lane] = intervalEnd[lane];
+					intervals[lane]++;
+
+					if (getDistance(lane, a, b) > distance) {
+						stop(lane);
+						continue;
+					}
+
+					if (intervals[lane] >= maxIntervals) {
+						time[lane] = -1.0;
+						stop(lane);
+						continue;
+					}
+
+					intervalEnd[lane] += interval;
+				}
+
+				step[lane] = std::min(step[lane], intervalEnd[lane] - time[lane]);
+			}
+		}
+	}
+
+private:
+
+	static const vector3D& axis(std::size_t k) {
+		static const vector3D axes[3] = { vector3D(1, 0, 0), vector3D(0, 1, 0), vector3D(0, 0, 1) };
+		return axes[k];
+	}
+
+	void stop(std::size_t lane) {
+		active[lane] = false;
+		step[lane] = 0.0;
+	}
+
+	double getDistance(std::size_t lane, identifier a, identifier b) const {
+		double d2 = 0.0;
+		for (std::size_t k = 0; k < 3; k++) {
+			double d = x[6 * a + k][lane] - x[6 * b + k][lane];
+			d2 += d * d;
+		}
+		return sqrt(d2);
+	}
+
+	void evaluate(const State &s, State &dsdt) {
+		for (std::size_t lane = 0; lane < Lanes; lane++)
+			evaluations[lane] += active[lane];
+
+		for (std::size_t body = 0; body < Bodies; body++) {
+			for (std::size_t k = 0; k < 3; k++) {
+				#pragma omp simd
+				for (std::size_t lane = 0; lane < Lanes; lane++) {
+					dsdt[6 * body + k][lane] = s[6 * body + 3 + k][lane];
+					dsdt[6 * body + 3 + k][lane] = 0.0;
+				}
+			}
+		}
+
+		for (std::size_t p = 0; p < pairCount; p++) {
+			const Pair &pair = pairs[p];
+			const Values &rx = s[pair.moon], &ex = s[pair.earth];
+			const Values &ry = s[pair.moon + 1], &ey = s[pair.earth + 1];
+			const Values &rz = s[pair.moon + 2], &ez = s[pair.earth + 2];
+
+			alignas(64) Values forceFactor;
+
+			#pragma omp simd
+			for (std::size_t lane = 0; lane < Lanes; lane++) {
+				double dx = rx[lane] - ex[lane], dy = ry[lane] - ey[lane], dz = rz[lane] - ez[lane];
+				double r2 = dx * dx + dy * dy + dz * dz;
+				forceFactor[lane] = pair.charge / (r2 * sqrt(r2));
+			}
+
+			if constexpr (Heisenberg) {
+				if (pair.heisenberg)
+					addHeisenberg(pair, s, dsdt, forceFactor);
+			}
+
+			for (std::size_t k = 0; k < 3; k++) {
+				const Values &moon = s[pair.moon + k], &earth = s[pair.earth + k];
+				Values &moonAcceleration = dsdt[pair.moon + 3 + k];
+				Values &earthAcceleration = dsdt[pair.earth + 3 + k];
+
+				#pragma omp simd
+				for (std::size_t lane = 0; lane < Lanes; lane++) {
+					double force = (moon[lane] - earth[lane]) * forceFactor[lane];
+					moonAcceleration[lane] += force * pair.inverseMoonMass;
+					earthAcceleration[lane] -= force * pair.inverseEarthMass;
+				}
+			}
+		}
+	}
+
+	// The Heisenberg core of HeisenbergInteraction, the moon taken to be an electron of unit mass.
+	void addHeisenberg(const Pair &pair, const State &s, State &dsdt, Values &forceFactor) {
+		alignas(64) Values velocityFactor;
+		alignas(64) std::array<Values, 3> v;
+
+		for (std::size_t k = 0; k < 3; k++) {
+			#pragma omp simd
+			for (std::size_t lane = 0; lane < Lanes; lane++)
+				v[k][lane] = s[pair.moon + 3 + k][lane] - s[pair.earth + 3 + k][lane];
+		}
+
+		#pragma omp simd
+		for (std::size_t lane = 0; lane < Lanes; lane++) {
+			double dx = s[pair.moon][lane] - s[pair.earth][lane];
+			double dy = s[pair.moon + 1][lane] - s[pair.earth + 1][lane];
+			double dz = s[pair.moon + 2][lane] - s[pair.earth + 2][lane];
+			double r2 = dx * dx + dy * dy + dz * dz;
+			double r4 = r2 * r2;
+			double p2 = (v[0][lane] * v[0][lane] + v[1][lane] * v[1][lane] + v[2][lane] * v[2][lane])
+					* pair.reducedMass * pair.reducedMass;
+			double p4 = p2 * p2;
+			double exponent = exponential(pair.alpha * (1 - r4 * p4 / pair.xi4));
+
+			forceFactor[lane] += pair.xi2SlashAlphaSlashMuSlash2 * exponent / r4 + p4 * exponent / pair.xi2DotMu;
+			velocityFactor[lane] = -p2 * pair.muSlashXi2 * r2 * exponent;
+		}
+
+		for (std::size_t k = 0; k < 3; k++) {
+			Values &moon = dsdt[pair.moon + k];
+			Values &earth = dsdt[pair.earth + k];
+
+			#pragma omp simd
+			for (std::size_t lane = 0; lane < Lanes; lane++) {
+				moon[lane] += v[k][lane] * velocityFactor[lane];
+				earth[lane] -= v[k][lane] * velocityFactor[lane] * pair.inverseEarthMass;
+			}
+		}
+	}
+
+	// The exponential function in a form the vectorizer takes, as libm's exp() is not: exp(x) = 2^n exp(r)
+	// with |r| <= ln(2) / 2 and the Taylor series of exp(r) to the 12th order, within an ulp or two.
+	// Arguments below -708 give zero, as they would soon after, without passing through denormal numbers.
+	static double exponential(double x) {
+		static constexpr std::array<double, 13> taylor = []() {
+			std::array<double, 13> coefficients { 1.0 };
+			for (int k = 1; k < 13; k++)
+				coefficients[k] = coefficients[k - 1] / k;
+			return coefficients;
+		}();
+
+		// Adding and subtracting 1.5 2^52 rounds to the nearest integer.
+		double y = x > -708.0 ? x : -708.0;
+		y = y < 709.0 ? y : 709.0;
+		double n = (y * 1.4426950408889634 + 6755399441055744.0) - 6755399441055744.0;
+		double r = y - n * 6.93147180369123816490e-01 - n * 1.90821492927058770002e-10;
+
+		double p = taylor[12];
+		#pragma GCC unroll 12
+		for (int k = 11; k >= 0; k--)
+			p = p * r + taylor[k];
+
+		// 2^n is built in the exponent bits: n + 1023 sits in the low bits of n + 1023 + 2^52.
+		double scale = std::bit_cast<double>(std::bit_cast<uint64_t>(n + 1023.0 + 4503599627370496.0) << 52);
+		return x > -708.0 ? p * scale : 0.0;
+	}
+
+	// Sets y to x + h sum(a_i k_i) over the given stages, one pass per stage so every pass vectorizes.
+	void combine(std::initializer_list<std::pair<double, const State*>> stages) {
+		y = x;
+		for (const auto &stage : stages) {
+			double a = stage.first;
+			const State &k = *stage.second;
+			for (std::size_t i = 0; i < Dimension; i++) {
+				#pragma omp simd
+				for (std::size_t lane = 0; lane < Lanes; lane++)
+					y[i][lane] += a * step[lane] * k[i][lane];
+			}
+		}
+	}
+
+	// One Dormand-Prince 5(4) step of every lane from x with k1 = f(x): the solution in y, f(y) in k7
+	// and the error estimate in error.
+	void tryStep() {
+		combine( { { 1.0 / 5, &k1 } });
+		evaluate(y, k2);
+		combine( { { 3.0 / 40, &k1 }, { 9.0 / 40, &k2 } });
+		evaluate(y, k3);
+		combine( { { 44.0 / 45, &k1 }, { -56.0 / 15, &k2 }, { 32.0 / 9, &k3 } });
+		evaluate(y, k4);
+		combine( { { 19372.0 / 6561, &k1 }, { -25360.0 / 2187, &k2 }, { 64448.0 / 6561, &k3 },
+				{ -212.0 / 729, &k4 } });
+		evaluate(y, k5);
+		combine( { { 9017.0 / 3168, &k1 }, { -355.0 / 33, &k2 }, { 46732.0 / 5247, &k3 }, { 49.0 / 176, &k4 },
+				{ -5103.0 / 18656, &k5 } });
+		evaluate(y, k6);
+		combine( { { 35.0 / 384, &k1 }, { 500.0 / 1113, &k3 }, { 125.0 / 192, &k4 }, { -2187.0 / 6784, &k5 },
+				{ 11.0 / 84, &k6 } });
+		evaluate(y, k7);
+
+		const double e1 = 35.0 / 384 - 5179.0 / 57600, e3 = 500.0 / 1113 - 7571.0 / 16695;
+		const double e4 = 125.0 / 192 - 393.0 / 640, e5 = -2187.0 / 6784 + 92097.0 / 339200;
+		const double e6 = 11.0 / 84 - 187.0 / 2100, e7 = -1.0 / 40;
+
+		for (std::size_t i = 0; i < Dimension; i++) {
+			#pragma omp simd
+			for (std::size_t lane = 0; lane < Lanes; lane++) {
+				error[i][lane] = step[lane]
+						* (e1 * k1[i][lane] + e3 * k3[i][lane] + e4 * k4[i][lane] + e5 * k5[i][lane]
+								+ e6 * k6[i][lane] + e7 * k7[i][lane]);
+			}
+		}
+	}
+
+	// Accepts or rejects the step of a lane and resizes it like odeint's default error checker and
+	// step adjuster do for the controlled dopri5 stepper.
+	bool adjustStep(std::size_t lane) {
+		double maximum = 0.0;
+		for (std::size_t i = 0; i < Dimension; i++) {
+			double scale = absoluteStepperError
+					+ relativeStepperError * (std::abs(x[i][lane]) + step[lane] * std::abs(k1[i][lane]));
+			maximum = std::max(maximum, std::abs(error[i][lane]) / scale);
+		}
+
+		if (maximum > 1.0) {
+			step[lane] *= std::max(0.9 * pow(maximum, -1.0 / 3.0), 0.2);
+			return false;
+		}
+
+		if (maximum < 0.5) {
+			maximum = std::max(pow(5.0, -5.0), maximum);
+			step[lane] *= 0.9 * pow(maximum, -1.0 / 5.0);
+		}
+
+		return true;
+	}
+};
+
+#endif /* LOCKSTEP_HPP */
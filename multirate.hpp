@@ -0,0 +1,186 @@
+#ifndef MULTIRATE_HPP
+#define MULTIRATE_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <vector>
+#include <simulbody/simulator.hpp>
+
+using namespace simulbody;
+
+// Multiple-time-step integration of a projectile passing a target (Strang splitting, as in RESPA).
+// The fast part, the free motion of all bodies and the interactions inside the target, runs on a
+// shadow system holding only those interactions, with the controlled stepper and its fine steps.
+// The slow part, the interactions of the projectile, acts as a half-step kick before and after every
+// outer step. The outer step is at most a fraction of the time the projectile needs to change its
+// distance to (or to orbit around) the nearest target body, and it is controlled so that the energy
+// error of a step stays within the tolerance. Where that leaves no room for several inner steps, in
+// the interaction region, the whole system is integrated as usual. The projectile forces are thus
+// evaluated far less often while the projectile is away, and as often as before while it is close.
+template<class Stepper>
+class MultirateSimulator {
+
+	Simulator<Stepper> simulator;
+	Simulator<Stepper> fastSimulator;
+	System* system;
+	System* fastSystem;
+	const uint64_t* evaluations;
+	const uint64_t* fastEvaluations;
+
+	std::vector<Interaction*> slowInteractions;
+	identifier projectile;
+	std::vector<identifier> targetBodies;
+
+	double stepFactor;
+	double energyTolerance;
+	double outerStep = INFINITY;
+	double innerStep = 0.0;
+
+	Phase k1, k2, k3, k4, y, saved;
+
+public:
+
+	// The shadow system has the bodies of the system in the same order and only the fast interactions.
+	// The evaluations of the right-hand sides of the two are counted, so the inner step carries over.
+	MultirateSimulator(Stepper stepper, System* system, System* fastSystem, const uint64_t* evaluations,
+			const uint64_t* fastEvaluations, std::vector<Interaction*> slowInteractions, identifier projectile,
+			std::span<const identifier> targetBodies, double stepFactor, double energyTolerance)
+			: simulator(stepper, system), fastSimulator(stepper, fastSystem), system(system), fastSystem(
+					fastSystem), evaluations(evaluations), fastEvaluations(fastEvaluations), slowInteractions(
+					slowInteractions), projectile(projectile), targetBodies(targetBodies.begin(),
+					targetBodies.end()), stepFactor(stepFactor), energyTolerance(energyTolerance) {
+	}
+
+	double simulate(double startTime, double endTime, double dt) {
+		double time = startTime;
+		if (innerStep <= 0.0)
+			innerStep = dt;
+
+		while (time < endTime) {
+			double limit = getStepLimit();
+			if (std::min(outerStep, limit) < minimumInnerSteps * innerStep) {
+				advanceTogether(time, endTime);
+				outerStep = limit;
+				break;
+			}
+
+			double step = std::min(std::min(outerStep, limit), endTime - time);
+
+			saved = system->phase;
+			double energy = system->getSystemEnergy();
+			double drift = advance(time, step);
+
+			// Only the splitting error counts, not the drift of the inner integration, which is controlled
+			// by the stepper. Outer steps are resized like the steps of a third order method.
+			double error = std::abs((system->getSystemEnergy() - energy - drift) / energy);
+			double factor = error > 0.0 ? 0.8 * cbrt(energyTolerance / error) : 2.0;
+			outerStep = step * std::min(2.0, std::max(0.2, factor));
+
+			if (error > energyTolerance && step > innerStep) {
+				system->phase = saved;
+				continue;
+			}
+
+			time += step;
+		}
+
+		return endTime;
+	}
+
+	// Runs in intervals of endTime - startTime until the condition holds, as Simulator does.
+	template<class Condition>
+	double simulate(double startTime, double endTime, double dt, Condition &condition, int maxRounds) {
+		double interval = endTime - startTime;
+		double time = startTime;
+
+		for (int round = 0; round < maxRounds; round++) {
+			time = simulate(time, time + interval, dt);
+			if (condition.evaluate(system->phase, time))
+				return time;
+		}
+
+		return -1.0;
+	}
+
+private:
+
+	static constexpr double minimumInnerSteps = 16.0;
+
+	// Returns the change of the energy of the shadow system during the inner integration.
+	double advance(double time, double step) {
+		kick(time, step / 2);
+
+		uint64_t start = *fastEvaluations;
+		fastSystem->phase = system->phase;
+		double energy = fastSystem->getSystemEnergy();
+		fastSimulator.simulate(time, time + step, std::min(innerStep, step));
+		double drift = fastSystem->getSystemEnergy() - energy;
+		system->phase = fastSystem->phase;
+		updateInnerStep(step, *fastEvaluations - start);
+
+		kick(time + step, step / 2);
+		return drift;
+	}
+
+	void advanceTogether(double time, double endTime) {
+		uint64_t start = *evaluations;
+		simulator.simulate(time, endTime, std::min(innerStep, endTime - time));
+		updateInnerStep(endTime - time, *evaluations - start);
+	}
+
+	// The controlled dopri5 stepper evaluates six times per step.
+	void updateInnerStep(double duration, uint64_t stepEvaluations) {
+		uint64_t steps = stepEvaluations / 6;
+		innerStep = duration / std::max((uint64_t) 1, steps);
+	}
+
+	// Shortest time scale between the projectile and a target body: the time to cover their distance
+	// at their relative speed, or the Kepler time at that distance.
+	double getStepLimit() const {
+		double scale = INFINITY;
+
+		for (identifier body : targetBodies) {
+			vector3D r = system->getBodyPosition(projectile) - system->getBodyPosition(body);
+			vector3D v = system->getBodyVelocity(projectile) - system->getBodyVelocity(body);
+			double distance = sqrt(r.scalarProduct(r));
+			double speed = sqrt(v.scalarProduct(v));
+
+			scale = std::min(scale, distance * sqrt(distance));
+			if (speed > 0.0)
+				scale = std::min(scale, distance / speed);
+		}
+
+		return stepFactor * scale;
+	}
+
+	void evaluateSlow(const Phase &x, Phase &dxdt, double t) {
+		dxdt.assign(x.size(), 0.0);
+		for (Interaction* interaction : slowInteractions) {
+			interaction->apply(x, dxdt, t);
+		}
+	}
+
+	// A classical Runge-Kutta step of the projectile interactions alone.
+	void kick(double t, double h) {
+		Phase &x = system->phase;
+		size_t n = x.size();
+
+		evaluateSlow(x, k1, t);
+		y.resize(n);
+		for (size_t i = 0; i < n; i++)
+			y[i] = x[i] + 0.5 * h * k1[i];
+		evaluateSlow(y, k2, t);
+		for (size_t i = 0; i < n; i++)
+			y[i] = x[i] + 0.5 * h * k2[i];
+		evaluateSlow(y, k3, t);
+		for (size_t i = 0; i < n; i++)
+			y[i] = x[i] + h * k3[i];
+		evaluateSlow(y, k4, t);
+
+		for (size_t i = 0; i < n; i++)
+			x[i] += h / 6.0 * (k1[i] + 2.0 * k2[i] + 2.0 * k3[i] + k4[i]);
+	}
+};
+
+#endif /* MULTIRATE_HPP */
@@ -0,0 +1,57 @@
+#ifndef RANDOM_HPP
+#define RANDOM_HPP
+
+#include <cstdint>
+
+// Counter-based random engine. The n-th number of a stream is a hash of the stream key and n,
+// so a stream keyed by (campaign seed, round) gives the same numbers wherever the round runs.
+class RandomEngine {
+
+	uint64_t key1;
+	uint64_t key2;
+	uint64_t counter;
+
+	static constexpr uint64_t mix(uint64_t z) {
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+public:
+
+	typedef uint64_t result_type;
+
+	static constexpr uint64_t default_seed = 5489u;
+
+	explicit RandomEngine(uint64_t seed = default_seed, uint64_t stream = 0) {
+		this->seed(seed, stream);
+	}
+
+	void seed(uint64_t seed, uint64_t stream = 0) {
+		key1 = mix(seed + 0x9e3779b97f4a7c15ull * (stream + 1));
+		key2 = mix(key1 ^ stream);
+		counter = 0;
+	}
+
+	result_type operator()() {
+		return mix(mix(key1 + 0x9e3779b97f4a7c15ull * counter++) ^ key2);
+	}
+
+	void discard(uint64_t n) {
+		counter += n;
+	}
+
+	uint64_t getCounter() const {
+		return counter;
+	}
+
+	static constexpr result_type min() {
+		return 0;
+	}
+
+	static constexpr result_type max() {
+		return UINT64_MAX;
+	}
+};
+
+#endif /* RANDOM_HPP */
@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "record.hpp"
+
+using namespace std;
+
+static const char recordFileMagic[8] = { 'B', 'B', 'R', 'E', 'C', 'R', 'D', '2' };
+static const char firstRecordFileMagic[8] = { 'B', 'B', 'R', 'E', 'C', 'R', 'D', '1' };
+static const size_t firstFieldsSize = 48;
+static const size_t headerFieldsSize = 48;
+
+static void put(vector<char> &bytes, size_t offset, const void* value, size_t size) {
+	memcpy(bytes.data() + offset, value, size);
+}
+
+string RecordHeader::outcomeName(int32_t outcome) const {
+	switch (outcome) {
+	case RoundRecord::noReaction:
+		return "No reaction";
+	case -1:
+		return "Distance not reached error";
+	case -2:
+		return "Energy error";
+	case -3:
+		return "Initial condition error";
+	}
+
+	if (outcome > 0 && (size_t) outcome <= channels.size())
+		return channels[outcome - 1];
+
+	return "Unknown outcome " + to_string(outcome);
+}
+
+// Rewrites a store without the records of the rounds after lastRound and without a record cut in half.
+static void keepRounds(const string &fileName, size_t headerSize, size_t recordSize, uint64_t lastRound) {
+	string temporaryFileName = fileName + ".tmp";
+	ifstream in(fileName, ios::binary);
+	ofstream out(temporaryFileName, ios::binary | ios::trunc);
+
+	vector<char> bytes(max(headerSize, recordSize));
+	in.read(bytes.data(), headerSize);
+	out.write(bytes.data(), headerSize);
+
+	while (in.read(bytes.data(), recordSize)) {
+		uint64_t round;
+		memcpy(&round, bytes.data(), 8);
+		if (round <= lastRound)
+			out.write(bytes.data(), recordSize);
+	}
+
+	out.close();
+	if (!out)
+		throw runtime_error("Failed to rewrite result store " + fileName + ".");
+
+	filesystem::rename(temporaryFileName, fileName);
+}
+
+void RecordWriter::open(const string &fileName, const RecordHeader &header, bool append, uint64_t lastRound,
+		double flushSeconds, size_t queueCapacity) {
+	size_t recordSize = fieldsSize + header.phaseLength * sizeof(double);
+
+	vector<char> bytes(headerFieldsSize, 0);
+	bytes.insert(bytes.end(), header.experiment.begin(), header.experiment.end());
+	bytes.push_back(0);
+	for (const string &channel : header.channels) {
+		bytes.insert(bytes.end(), channel.begin(), channel.end());
+		bytes.push_back(0);
+	}
+	bytes.resize((bytes.size() + 7) / 8 * 8, 0);
+
+	uint32_t sizes[4] = { (uint32_t) bytes.size(), (uint32_t) recordSize, header.phaseLength,
+			(uint32_t) header.channels.size() };
+	put(bytes, 0, recordFileMagic, 8);
+	put(bytes, 8, sizes, sizeof(sizes));
+	put(bytes, 24, &header.b2max, 8);
+	put(bytes, 32, &header.energy, 8);
+	put(bytes, 40, &header.seed, 8);
+
+	// The store of an interrupted campaign holds the rounds finished after its last checkpoint too, and
+	// maybe a record cut in half. Only the rounds the checkpoint counts are kept; a store written with another
+	// header is left alone.
+	bool appending = false;
+	if (append && filesystem::exists(fileName)) {
+		vector<char> existing(bytes.size(), 0);
+		ifstream in(fileName, ios::binary);
+		in.read(existing.data(), existing.size());
+
+		if (!in || existing != bytes)
+			throw runtime_error("Result store " + fileName + " does not belong to this campaign.");
+
+		in.close();
+		keepRounds(fileName, bytes.size(), recordSize, lastRound);
+		appending = true;
+	}
+
+	stream.open(fileName, ios::binary | (appending ? ios::app : ios::trunc));
+	if (!stream)
+		throw runtime_error("Failed to open result store " + fileName + ".");
+
+	if (!appending) {
+		stream.write(bytes.data(), bytes.size());
+		stream.flush();
+		if (!stream)
+			throw runtime_error("Failed to write result store " + fileName + ".");
+	}
+
+	this->fileName = fileName;
+	this->recordSize = recordSize;
+	this->flushInterval = chrono::milliseconds((long) (1000 * flushSeconds));
+
+	capacity = 1;
+	while (capacity < queueCapacity) {
+		capacity *= 2;
+	}
+
+	slots.reset(new Slot[capacity]);
+	for (size_t i = 0; i < capacity; i++) {
+		slots[i].sequence.store(i, memory_order_relaxed);
+	}
+
+	arena.assign(capacity * recordSize, 0);
+	enqueuePosition.store(0);
+	dequeuePosition = 0;
+	flushRequested.store(false);
+	flushedPosition.store(0);
+	failed.store(false);
+
+	running = true;
+	thread = std::thread(&RecordWriter::writeBatches, this);
+}
+
+void RecordWriter::write(const RoundRecord &round) {
+	size_t position = enqueuePosition.load(memory_order_relaxed);
+	Slot* slot;
+
+	// Bounded multi-producer queue: a slot is free for the producer whose position equals its sequence.
+	while (true) {
+		slot = &slots[position & (capacity - 1)];
+		size_t sequence = slot->sequence.load(memory_order_acquire);
+		intptr_t difference = (intptr_t) sequence - (intptr_t) position;
+
+		if (difference == 0) {
+			if (enqueuePosition.compare_exchange_weak(position, position + 1, memory_order_relaxed))
+				break;
+		} else if (difference < 0) {
+			// The queue is full: the disk is slower than the simulation.
+			this_thread::yield();
+			position = enqueuePosition.load(memory_order_relaxed);
+		} else {
+			position = enqueuePosition.load(memory_order_relaxed);
+		}
+	}
+
+	char* record = arena.data() + (position & (capacity - 1)) * recordSize;
+	memcpy(record, &round.round, 8);
+	memcpy(record + 8, &round.impactParameter, 8);
+	memcpy(record + 16, &round.endTime, 8);
+	memcpy(record + 24, &round.energyError, 8);
+	memcpy(record + 32, &round.evaluations, 8);
+	memcpy(record + 40, &round.outcome, 4);
+	memcpy(record + 44, &round.extensions, 4);
+	memcpy(record + 48, &round.tier, 4);
+	memset(record + 52, 0, 4);
+
+	size_t phaseSize = min(round.initialPhase.size() * sizeof(double), recordSize - fieldsSize);
+	memset(record + fieldsSize, 0, recordSize - fieldsSize);
+	memcpy(record + fieldsSize, round.initialPhase.data(), phaseSize);
+
+	slot->sequence.store(position + 1, memory_order_release);
+}
+
+size_t RecordWriter::drain(vector<char> &batch) {
+	size_t count = 0;
+
+	while (count < capacity) {
+		Slot &slot = slots[dequeuePosition & (capacity - 1)];
+		if (slot.sequence.load(memory_order_acquire) != dequeuePosition + 1)
+			break;
+
+		const char* record = arena.data() + (dequeuePosition & (capacity - 1)) * recordSize;
+		batch.insert(batch.end(), record, record + recordSize);
+
+		slot.sequence.store(dequeuePosition + capacity, memory_order_release);
+		dequeuePosition++;
+		count++;
+	}
+
+	return count;
+}
+
+void RecordWriter::writeBatches() {
+	vector<char> batch;
+	batch.reserve(capacity * recordSize);
+	auto lastFlush = chrono::steady_clock::now();
+
+	while (true) {
+		bool stopping = !running.load(memory_order_acquire);
+
+		batch.clear();
+		size_t count = drain(batch);
+		if (count != 0)
+			stream.write(batch.data(), batch.size());
+
+		// Records that did not reach the file are never counted as flushed: the checkpoint must not cover them.
+		if (flushRequested.exchange(false, memory_order_acq_rel)
+				|| chrono::steady_clock::now() - lastFlush >= flushInterval) {
+			stream.flush();
+			lastFlush = chrono::steady_clock::now();
+			if (stream)
+				flushedPosition.store(dequeuePosition, memory_order_release);
+		}
+
+		if (!stream)
+			failed.store(true, memory_order_release);
+
+		if (stopping && count == 0)
+			break;
+
+		if (count == 0)
+			this_thread::sleep_for(chrono::milliseconds(1));
+	}
+
+	stream.flush();
+}
+
+void RecordWriter::flush() {
+	if (!thread.joinable())
+		return;
+
+	// Records enqueued before the call may still be copied in by their writers; the thread drains them
+	// as soon as they are complete.
+	size_t position = enqueuePosition.load(memory_order_acquire);
+	while (flushedPosition.load(memory_order_acquire) < position && !failed.load(memory_order_acquire)) {
+		flushRequested.store(true, memory_order_release);
+		this_thread::sleep_for(chrono::milliseconds(1));
+	}
+
+	if (failed.load(memory_order_acquire))
+		throw runtime_error("Failed to write result store " + fileName + ".");
+}
+
+void RecordWriter::close() {
+	if (thread.joinable()) {
+		running.store(false, memory_order_release);
+		thread.join();
+	}
+
+	if (stream.is_open()) {
+		stream.close();
+		if (!stream)
+			failed.store(true);
+	}
+
+	// The failure is reported once, the destructor closing again.
+	if (failed.exchange(false))
+		throw runtime_error("Failed to write result store " + fileName + ".");
+}
+
+RecordWriter::~RecordWriter() {
+	try {
+		close();
+	} catch (const exception &e) {
+		cerr << e.what() << endl;
+	}
+}
+
+RecordReader::RecordReader(const string &fileName) {
+	descriptor = ::open(fileName.c_str(), O_RDONLY);
+	if (descriptor < 0)
+		throw runtime_error("Failed to open result store " + fileName + ".");
+
+	struct stat status;
+	fstat(descriptor, &status);
+	fileSize = status.st_size;
+
+	if (fileSize < headerFieldsSize) {
+		::close(descriptor);
+		throw runtime_error(fileName + " is not a result store.");
+	}
+
+	void* mapping = mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, descriptor, 0);
+	if (mapping == MAP_FAILED) {
+		::close(descriptor);
+		throw runtime_error("Failed to map result store " + fileName + ".");
+	}
+
+	data = static_cast<const char*>(mapping);
+	madvise(mapping, fileSize, MADV_SEQUENTIAL);
+
+	uint32_t sizes[4];
+	memcpy(sizes, data + 8, sizeof(sizes));
+	headerSize = sizes[0];
+	recordSize = sizes[1];
+	header.phaseLength = sizes[2];
+
+	if (memcmp(data, recordFileMagic, 8) == 0)
+		fieldsSize = RecordWriter::fieldsSize;
+	else if (memcmp(data, firstRecordFileMagic, 8) == 0)
+		fieldsSize = firstFieldsSize;
+
+	if (fieldsSize == 0 || headerSize > fileSize || recordSize != fieldsSize + header.phaseLength * sizeof(double)) {
+		munmap(mapping, fileSize);
+		::close(descriptor);
+		throw runtime_error(fileName + " is not a result store.");
+	}
+
+	memcpy(&header.b2max, data + 24, 8);
+	memcpy(&header.energy, data + 32, 8);
+	memcpy(&header.seed, data + 40, 8);
+
+	const char* name = data + headerFieldsSize;
+	header.experiment = string(name);
+	for (uint32_t c = 0; c < sizes[3]; c++) {
+		name += strlen(name) + 1;
+		header.channels.push_back(string(name));
+	}
+}
+
+template<class T>
+T RecordReader::field(size_t index, size_t offset) const {
+	T value;
+	memcpy(&value, data + headerSize + index * recordSize + offset, sizeof(T));
+	return value;
+}
+
+const RecordHeader& RecordReader::getHeader() const {
+	return header;
+}
+
+size_t RecordReader::size() const {
+	return (fileSize - headerSize) / recordSize;
+}
+
+uint64_t RecordReader::round(size_t index) const {
+	return field<uint64_t>(index, 0);
+}
+
+double RecordReader::impactParameter(size_t index) const {
+	return field<double>(index, 8);
+}
+
+double RecordReader::endTime(size_t index) const {
+	return field<double>(index, 16);
+}
+
+double RecordReader::energyError(size_t index) const {
+	return field<double>(index, 24);
+}
+
+uint64_t RecordReader::evaluations(size_t index) const {
+	return field<uint64_t>(index, 32);
+}
+
+int32_t RecordReader::outcome(size_t index) const {
+	return field<int32_t>(index, 40);
+}
+
+int32_t RecordReader::extensions(size_t index) const {
+	return field<int32_t>(index, 44);
+}
+
+int32_t RecordReader::tier(size_t index) const {
+	return fieldsSize > firstFieldsSize ? field<int32_t>(index, 48) : 0;
+}
+
+const double* RecordReader::initialPhase(size_t index) const {
+	// Records are 8-byte aligned: the header is padded and the fixed fields take 56 (48) bytes.
+	return reinterpret_cast<const double*>(data + headerSize + index * recordSize + fieldsSize);
+}
+
+RecordReader::~RecordReader() {
+	munmap(const_cast<char*>(data), fileSize);
+	::close(descriptor);
+}
@@ -0,0 +1,135 @@
+#ifndef RECORD_HPP
+#define RECORD_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Per-round result of a collision experiment.
+//
+// The outcome is 0 if the round ended without reaction, c + 1 if it ended in the reaction
+// channel c, and the (negative) failure code of Experiment::run() if the round failed.
+struct RoundRecord {
+
+	static constexpr int32_t noReaction = 0;
+
+	uint64_t round = 0;
+	double impactParameter = 0.0;
+	double endTime = 0.0;
+	double energyError = 0.0;
+	uint64_t evaluations = 0;
+	int32_t outcome = noReaction;
+	int32_t extensions = 0;
+	int32_t tier = 0;			// retry tier the round was integrated at, 0 if not retried
+
+	std::vector<double> initialPhase;
+};
+
+// Campaign-wide description stored at the beginning of a result store.
+struct RecordHeader {
+	std::string experiment;
+	double b2max = 0.0;
+	double energy = 0.0;
+	uint64_t seed = 0;
+	uint32_t phaseLength = 0;
+	std::vector<std::string> channels;
+
+	std::string outcomeName(int32_t outcome) const;
+};
+
+// Result store of fixed-size binary records: the fields of RoundRecord in declaration order, padded
+// to 8 bytes, followed by the initial phase. Records are written in the order the rounds finish.
+// Stores of the first version, without the tier, are read too.
+//
+// Any number of threads may write records. They are serialized into a bounded lock-free queue
+// and written to disk in large batches by a dedicated thread, so writers never wait for the disk.
+// The file is flushed every flush interval, on flush() and when the writer is closed.
+class RecordWriter {
+
+	struct Slot {
+		std::atomic<std::size_t> sequence;
+	};
+
+	std::string fileName;
+	std::ofstream stream;
+	std::size_t recordSize = 0;
+
+	std::size_t capacity = 0;
+	std::unique_ptr<Slot[]> slots;
+	std::vector<char> arena;
+	std::atomic<std::size_t> enqueuePosition { 0 };
+	std::size_t dequeuePosition = 0;
+
+	std::thread thread;
+	std::atomic<bool> running { false };
+	std::chrono::milliseconds flushInterval { 0 };
+	std::atomic<bool> flushRequested { false };
+	std::atomic<std::size_t> flushedPosition { 0 };	// records before it are on disk
+	std::atomic<bool> failed { false };			// a write or flush of the stream failed
+
+	std::size_t drain(std::vector<char> &batch);
+	void writeBatches();
+
+public:
+
+	// Appending to the store of an interrupted campaign keeps the records of the rounds up to lastRound only,
+	// the rounds after it being carried out again.
+	void open(const std::string &fileName, const RecordHeader &header, bool append, uint64_t lastRound,
+			double flushSeconds = 5.0, std::size_t queueCapacity = 1 << 14);
+	void write(const RoundRecord &record);
+
+	// Waits until every record written before the call is flushed to the file. Throws if writing the file
+	// failed, as close does.
+	void flush();
+
+	void close();
+
+	~RecordWriter();
+
+	static constexpr std::size_t fieldsSize = 56;
+};
+
+// Read-only view of a result store mapped into memory.
+class RecordReader {
+
+	int descriptor = -1;
+	const char* data = nullptr;
+	std::size_t fileSize = 0;
+	std::size_t headerSize = 0;
+	std::size_t recordSize = 0;
+	std::size_t fieldsSize = 0;
+
+	RecordHeader header;
+
+	template<class T>
+	T field(std::size_t index, std::size_t offset) const;
+
+public:
+
+	explicit RecordReader(const std::string &fileName);
+	RecordReader(const RecordReader&) = delete;
+	RecordReader& operator=(const RecordReader&) = delete;
+
+	const RecordHeader& getHeader() const;
+	std::size_t size() const;
+
+	uint64_t round(std::size_t index) const;
+	double impactParameter(std::size_t index) const;
+	double endTime(std::size_t index) const;
+	double energyError(std::size_t index) const;
+	uint64_t evaluations(std::size_t index) const;
+	int32_t outcome(std::size_t index) const;
+	int32_t extensions(std::size_t index) const;
+	int32_t tier(std::size_t index) const;
+	const double* initialPhase(std::size_t index) const;
+
+	~RecordReader();
+};
+
+#endif /* RECORD_HPP */
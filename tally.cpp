@@ -0,0 +1,305 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+
+#include "tally.hpp"
+
+using namespace std;
+
+static const string tallyFileHeader = "bohrbiter-tally 1";
+
+void Tally::reset() {
+	successful = 0;
+	failed = 0;
+	extended = 0;
+	retried = 0;
+	predicted = 0;
+	outcomes.assign(outcomes.size(), 0);
+	stratumRounds.assign(stratumRounds.size(), 0);
+	stratumOutcomes.assign(stratumOutcomes.size(), 0);
+}
+
+void Tally::add(const Tally &other) {
+	if (outcomes.size() < other.outcomes.size())
+		outcomes.resize(other.outcomes.size(), 0);
+
+	for (size_t i = 0; i < other.outcomes.size(); i++) {
+		outcomes[i] += other.outcomes[i];
+	}
+
+	if (stratumRounds.size() < other.stratumRounds.size())
+		stratumRounds.resize(other.stratumRounds.size(), 0);
+	if (stratumOutcomes.size() < other.stratumOutcomes.size())
+		stratumOutcomes.resize(other.stratumOutcomes.size(), 0);
+
+	for (size_t i = 0; i < other.stratumRounds.size(); i++) {
+		stratumRounds[i] += other.stratumRounds[i];
+	}
+	for (size_t i = 0; i < other.stratumOutcomes.size(); i++) {
+		stratumOutcomes[i] += other.stratumOutcomes[i];
+	}
+
+	successful += other.successful;
+	failed += other.failed;
+	extended += other.extended;
+	retried += other.retried;
+	predicted += other.predicted;
+}
+
+bool Tally::isCompatible(const Tally &other) const {
+	return experiment == other.experiment && b2max == other.b2max && energy == other.energy
+			&& seed == other.seed && rounds == other.rounds && shards == other.shards
+			&& outcomes.size() == other.outcomes.size() && strata == other.strata && pilot == other.pilot;
+}
+
+void Tally::stratify(int strata, int pilot) {
+	this->strata = strata;
+	this->pilot = pilot;
+	allocation.clear();
+	stratumRounds.assign(strata, 0);
+	stratumOutcomes.assign(strata * outcomes.size(), 0);
+}
+
+int Tally::stratumOf(long round) const {
+	if (strata == 0)
+		return 0;
+
+	// The pilot visits the strata in turn.
+	if (allocation.empty())
+		return round % strata;
+
+	// Afterwards the golden ratio sequence spreads the rounds over the strata in proportion to the
+	// allocation. It depends on the round only, so any thread assigns a round the same way. Shards
+	// allocate from pilots of their own, so a merged sharded tally differs from a single run.
+	double u = (double) ((uint64_t) round * 0x9e3779b97f4a7c15ull) / 18446744073709551616.0;
+	double cumulated = 0.0;
+	for (int h = 0; h < strata - 1; h++) {
+		cumulated += allocation[h];
+		if (u < cumulated)
+			return h;
+	}
+
+	return strata - 1;
+}
+
+void Tally::countInStratum(int stratum) {
+	if (strata == 0)
+		return;
+
+	stratumRounds[stratum] += successful;
+	for (size_t c = 0; c < outcomes.size(); c++) {
+		stratumOutcomes[stratum * outcomes.size() + c] += outcomes[c];
+	}
+}
+
+void Tally::allocate(const vector<size_t> &targets) {
+	// Neyman allocation: rounds in proportion to the standard deviation of the stratum, summed over the
+	// target channels (all if none). The pilot estimates are smoothed so a stratum without reactions
+	// is not abandoned.
+	vector<size_t> channels = targets;
+	if (channels.empty()) {
+		for (size_t c = 0; c < outcomes.size(); c++) {
+			channels.push_back(c);
+		}
+	}
+
+	vector<double> deviations(strata, 0.0);
+	double sum = 0.0;
+	for (int h = 0; h < strata; h++) {
+		double variance = 0.0;
+		for (size_t c : channels) {
+			double p = (stratumOutcomes[h * outcomes.size() + c] + 1.0) / (stratumRounds[h] + 2.0);
+			variance += p * (1.0 - p);
+		}
+
+		deviations[h] = sqrt(variance);
+		sum += deviations[h];
+	}
+
+	// Every stratum keeps at least a tenth of its even share.
+	double minimum = 0.1 / strata;
+	double total = 0.0;
+	allocation.assign(strata, 0.0);
+	for (int h = 0; h < strata; h++) {
+		allocation[h] = max(minimum, deviations[h] / sum);
+		total += allocation[h];
+	}
+
+	for (double &fraction : allocation) {
+		fraction /= total;
+	}
+}
+
+double Tally::estimate(size_t outcome, double &error) const {
+	if (strata == 0) {
+		if (successful == 0) {
+			error = 0.0;
+			return 0.0;
+		}
+
+		double p = ((double) outcomes[outcome]) / successful;
+		error = sqrt(p * (1.0 - p) / successful);
+		return p;
+	}
+
+	// Strata are of equal weight.
+	double weight = 1.0 / strata;
+	double p = 0.0;
+	double variance = 0.0;
+	for (int h = 0; h < strata; h++) {
+		if (stratumRounds[h] == 0)
+			continue;
+
+		double ph = ((double) stratumOutcomes[h * outcomes.size() + outcome]) / stratumRounds[h];
+		p += weight * ph;
+		variance += weight * weight * ph * (1.0 - ph) / stratumRounds[h];
+	}
+
+	error = sqrt(variance);
+	return p;
+}
+
+void Tally::write(const string &fileName) const {
+	ofstream stream(fileName);
+	stream.precision(17);
+
+	stream << tallyFileHeader << endl;
+	stream << "experiment " << experiment << endl;
+	stream << "b2max " << b2max << endl;
+	stream << "energy " << energy << endl;
+	stream << "seed " << seed << endl;
+	stream << "rounds " << rounds << endl;
+	stream << "shard " << shard << " " << shards << endl;
+	stream << "cursor " << cursor << endl;
+	stream << "successful " << successful << endl;
+	stream << "failed " << failed << endl;
+	stream << "extended " << extended << endl;
+	stream << "retried " << retried << endl;
+	stream << "predicted " << predicted << endl;
+	stream << "outcomes " << outcomes.size();
+	for (long count : outcomes) {
+		stream << " " << count;
+	}
+	stream << endl;
+
+	if (strata != 0) {
+		stream << "strata " << strata << " " << pilot << endl;
+		stream << "allocation " << allocation.size();
+		for (double fraction : allocation) {
+			stream << " " << fraction;
+		}
+		stream << endl;
+		stream << "stratum-rounds " << stratumRounds.size();
+		for (long count : stratumRounds) {
+			stream << " " << count;
+		}
+		stream << endl;
+		stream << "stratum-outcomes " << stratumOutcomes.size();
+		for (long count : stratumOutcomes) {
+			stream << " " << count;
+		}
+		stream << endl;
+	}
+
+	if (!stream)
+		throw runtime_error("Failed to write tally file " + fileName + ".");
+}
+
+void Tally::interval(size_t outcome, double z, double &low, double &high) const {
+	double error = 0.0;
+	double p = estimate(outcome, error);
+
+	// A stratified estimate counts as many rounds as a simple one of the same error would need.
+	double n = error > 0.0 ? p * (1.0 - p) / (error * error) : (double) successful;
+	if (n <= 0.0) {
+		low = 0.0;
+		high = 1.0;
+		return;
+	}
+
+	double z2 = z * z;
+	double center = (p + z2 / (2.0 * n)) / (1.0 + z2 / n);
+	double halfWidth = z / (1.0 + z2 / n) * sqrt(p * (1.0 - p) / n + z2 / (4.0 * n * n));
+	low = max(0.0, center - halfWidth);
+	high = min(1.0, center + halfWidth);
+}
+
+// static
+Tally Tally::read(const string &fileName) {
+	ifstream stream(fileName);
+	if (!stream)
+		throw runtime_error("Failed to open tally file " + fileName + ".");
+
+	string header;
+	getline(stream, header);
+	if (header != tallyFileHeader)
+		throw runtime_error(fileName + " is not a tally file.");
+
+	Tally tally;
+	string key;
+	while (stream >> key) {
+		if (key == "experiment") {
+			stream >> tally.experiment;
+		} else if (key == "b2max") {
+			stream >> tally.b2max;
+		} else if (key == "energy") {
+			stream >> tally.energy;
+		} else if (key == "seed") {
+			stream >> tally.seed;
+		} else if (key == "rounds") {
+			stream >> tally.rounds;
+		} else if (key == "shard") {
+			stream >> tally.shard >> tally.shards;
+		} else if (key == "cursor") {
+			stream >> tally.cursor;
+		} else if (key == "successful") {
+			stream >> tally.successful;
+		} else if (key == "failed") {
+			stream >> tally.failed;
+		} else if (key == "extended") {
+			stream >> tally.extended;
+		} else if (key == "retried") {
+			stream >> tally.retried;
+		} else if (key == "predicted") {
+			stream >> tally.predicted;
+		} else if (key == "outcomes") {
+			size_t size = 0;
+			stream >> size;
+			tally.outcomes.resize(size);
+			for (long &count : tally.outcomes) {
+				stream >> count;
+			}
+		} else if (key == "strata") {
+			stream >> tally.strata >> tally.pilot;
+		} else if (key == "allocation") {
+			size_t size = 0;
+			stream >> size;
+			tally.allocation.resize(size);
+			for (double &fraction : tally.allocation) {
+				stream >> fraction;
+			}
+		} else if (key == "stratum-rounds") {
+			size_t size = 0;
+			stream >> size;
+			tally.stratumRounds.resize(size);
+			for (long &count : tally.stratumRounds) {
+				stream >> count;
+			}
+		} else if (key == "stratum-outcomes") {
+			size_t size = 0;
+			stream >> size;
+			tally.stratumOutcomes.resize(size);
+			for (long &count : tally.stratumOutcomes) {
+				stream >> count;
+			}
+		} else {
+			throw runtime_error("Unknown key '" + key + "' in tally file " + fileName + ".");
+		}
+
+		if (!stream)
+			throw runtime_error("Malformed tally file " + fileName + ".");
+	}
+
+	return tally;
+}
@@ -0,0 +1,57 @@
+#ifndef TALLY_HPP
+#define TALLY_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Raw outcome counts of a campaign (or of a slice of it) together with the parameters
+// needed to turn them into cross sections. Tallies of disjoint slices can be merged.
+struct Tally {
+
+	std::string experiment;
+	double b2max = 0.0;
+	double energy = 0.0;
+	uint64_t seed = 0;
+
+	int rounds = 0;
+	int shard = 1;
+	int shards = 1;
+	int cursor = 0;		// rounds before the cursor are all counted in the tally
+
+	long successful = 0;
+	long failed = 0;
+	long extended = 0;
+	long retried = 0;		// successful or not, rounds integrated again at tighter tolerances
+	long predicted = 0;		// rounds whose outcome was decided from the two-body orbits
+	std::vector<long> outcomes;
+
+	// Stratified sampling: the impact parameter is drawn from one of the shells of equal width in b²,
+	// the estimates weight the strata equally.
+	int strata = 0;					// 0 if not stratified
+	int pilot = 0;					// rounds sampled evenly before the allocation
+	std::vector<double> allocation;	// fraction of the rounds drawn in each stratum after the pilot
+	std::vector<long> stratumRounds;	// successful rounds per stratum
+	std::vector<long> stratumOutcomes;	// outcomes per stratum, a row of channels each
+
+	void reset();
+	void add(const Tally &other);
+	bool isCompatible(const Tally &other) const;
+
+	void stratify(int strata, int pilot);
+	int stratumOf(long round) const;
+	void countInStratum(int stratum);
+	void allocate(const std::vector<std::size_t> &targets = { });
+
+	// Estimated probability of the outcome and its standard error.
+	double estimate(std::size_t outcome, double &error) const;
+
+	// Wilson score interval of the probability of the outcome at z standard deviations.
+	void interval(std::size_t outcome, double z, double &low, double &high) const;
+
+	void write(const std::string &fileName) const;
+	static Tally read(const std::string &fileName);
+};
+
+#endif /* TALLY_HPP */